@@ -0,0 +1,16 @@
+# Runs LexerGen on SPEC with the space separated OPTIONS and writes the four outputs to OUT. The state listing goes
+# to OUT/states.txt instead of the build log.
+#
+#   cmake -DGENERATOR=<LexerGen> -DSPEC=<spec> -DOUT=<dir> [-DOPTIONS="--table ..."] -P Generate.cmake
+
+separate_arguments(options UNIX_COMMAND "${OPTIONS}")
+file(MAKE_DIRECTORY ${OUT})
+
+execute_process(
+    COMMAND ${GENERATOR} ${options} ${SPEC} ${OUT}/Symbol.h ${OUT}/Terminals.h ${OUT}/Lexer.h ${OUT}/Lexer.cpp
+    OUTPUT_FILE ${OUT}/states.txt
+    RESULT_VARIABLE result
+)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "LexerGen ${OPTIONS} ${SPEC} failed: ${result}")
+endif()
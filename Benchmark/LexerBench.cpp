@@ -0,0 +1,91 @@
+#if defined(BENCH_LAZY)
+#include "LazyLexer.h"
+#elif defined(BENCH_MAPPED)
+#include "MappedLexer.h"
+#else
+#include "Lexer.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Lexes a corpus several times over with the lexer it was built against and prints the median run as one JSON line.
+// The token mode is whatever the generated Lexer.h was emitted with; build with BENCH_PARALLEL for a --parallel lexer.
+// BENCH_LAZY="<spec>" times the runtime LazyLexer on that spec instead, and BENCH_MAPPED="<file>" the MappedLexer on a
+// --binary DFA.
+//
+//   LexerBench <name> <corpus> [runs]
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: LexerBench <name> <corpus> [runs]" << std::endl;
+        return 1;
+    }
+    size_t runs = (argc == 4) ? std::strtoul(argv[3], nullptr, 10) : 5;
+    if (runs == 0)
+        runs = 1;
+
+    auto read = [](const char *path, std::string &text) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Failed to open file: " << path << std::endl;
+            return false;
+        }
+        text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    };
+    std::string text;
+    if (!read(argv[2], text))
+        return 1;
+
+#ifdef BENCH_LAZY
+    // the DFA is kept from run to run, so only the first run pays for determinizing the states the corpus reaches
+    std::string spec;
+    if (!read(BENCH_LAZY, spec))
+        return 1;
+    LazyDFA dfa(spec);
+#elif defined(BENCH_MAPPED)
+    MappedDFA dfa(BENCH_MAPPED);
+#endif
+
+    std::vector<double> seconds;
+    size_t tokens = 0;
+    for (size_t run = 0; run < runs; run++) {
+#if defined(BENCH_LAZY)
+        LazyLexer lexer(dfa, text);
+#elif defined(BENCH_MAPPED)
+        MappedLexer lexer(dfa, text);
+#else
+        Lexer lexer(text);
+#endif
+
+        auto start = std::chrono::steady_clock::now();
+#ifdef BENCH_PARALLEL
+        bool ok = lexer.CreateTokensParallel();
+#else
+        bool ok = lexer.CreateTokens();
+#endif
+        auto stop = std::chrono::steady_clock::now();
+
+        if (!ok) {
+            std::cerr << argv[1] << ": lexing failed at \"" << lexer.GetErrorReport().Token.substr(0, 40) << '"' << std::endl;
+            return 1;
+        }
+        // tokens are counted and freed outside the timed region, which only covers lexing itself
+        tokens = lexer.GetTokens().size();
+        seconds.push_back(std::chrono::duration<double>(stop - start).count());
+    }
+
+    std::sort(seconds.begin(), seconds.end());
+    double median = seconds[seconds.size() / 2];
+
+    std::cout << "{ \"lexer\": \"" << argv[1] << "\", \"bytes\": " << text.size() << ", \"tokens\": " << tokens <<
+        ", \"runs\": " << runs << ", \"median_ms\": " << median * 1e3 << ", \"min_ms\": " << seconds.front() * 1e3 <<
+        ", \"mb_per_s\": " << text.size() / median / 1e6 << ", \"tokens_per_s\": " << tokens / median << " }" << std::endl;
+}
@@ -0,0 +1,106 @@
+# Times every generator phase on the synthetic specs, then every benchmark lexer on the corpus. Prints a summary and
+# writes all numbers to DIR/results.json.
+#
+# Generator phases report the fastest of GENERATOR_RUNS runs, because the best time is the least disturbed by other
+# load. Each spec's summary line gives its DFA states before and after minimization next to the phase times, so the
+# minimize phase can be read against the size of its input. The lexers report the median of LEXER_RUNS runs.
+#
+#   cmake -DGENERATOR=<LexerGen> -DSPECGEN=<SpecGen> -DDIR=<dir> -DCORPUS=<file> -DRULES="10 100 ..."
+#         -DGENERATOR_RUNS=<n> -DLEXER_RUNS=<n> -DLEXERS="<name>=<exe> ..." -P RunBenchmarks.cmake
+
+cmake_minimum_required(VERSION 3.13)
+
+separate_arguments(rules UNIX_COMMAND "${RULES}")
+separate_arguments(lexers UNIX_COMMAND "${LEXERS}")
+set(work ${DIR}/generator)
+file(MAKE_DIRECTORY ${work})
+
+set(json "{\n  \"generator\": [")
+set(separator "\n")
+
+foreach (family keywords patterns)
+    foreach (count ${rules})
+        execute_process(COMMAND ${SPECGEN} ${family} ${count} ${work}/spec.txt ${work}/stubs.cpp RESULT_VARIABLE result)
+        if (NOT result EQUAL 0)
+            message(FATAL_ERROR "SpecGen ${family} ${count} failed: ${result}")
+        endif()
+
+        # the numbers are taken from the report as text, since string(JSON) would print them back at full precision
+        unset(phases)
+        foreach (run RANGE 1 ${GENERATOR_RUNS})
+            execute_process(
+                COMMAND ${GENERATOR} --stats=json spec.txt Symbol.h Terminals.h Lexer.h Lexer.cpp
+                WORKING_DIRECTORY ${work}
+                OUTPUT_QUIET
+                ERROR_VARIABLE stats
+                RESULT_VARIABLE result
+            )
+            if (NOT result EQUAL 0)
+                message(FATAL_ERROR "LexerGen on ${family} ${count} failed: ${result}")
+            endif()
+
+            string(REGEX MATCHALL "\"name\": \"[a-z]+\", \"ms\": [0-9.]+" times "${stats}")
+            foreach (time ${times})
+                string(REGEX REPLACE ".*\"name\": \"([a-z]+)\", \"ms\": ([0-9.]+)" "\\1;\\2" time "${time}")
+                list(GET time 0 name)
+                list(GET time 1 ms)
+                if (run EQUAL 1 OR ms LESS best_${name})
+                    set(best_${name} ${ms})
+                endif()
+                if (run EQUAL 1)
+                    list(APPEND phases ${name})
+                endif()
+            endforeach()
+        endforeach()
+
+        string(REGEX MATCH "\"sizes\": ({[^}]*})" sizes "${stats}")
+        set(sizes "${CMAKE_MATCH_1}")
+        string(REGEX MATCH "\"dfa_states\": ([0-9]+)" states "${stats}")
+        set(dfaStates ${CMAKE_MATCH_1})
+        string(REGEX MATCH "\"minimized_states\": ([0-9]+)" states "${stats}")
+        set(states ${CMAKE_MATCH_1})
+        set(summary "")
+        set(entry "")
+        foreach (name ${phases})
+            string(APPEND summary " ${name} ${best_${name}}")
+            string(APPEND entry "\"${name}\": ${best_${name}}, ")
+        endforeach()
+        string(REGEX REPLACE ", $" "" entry "${entry}")
+        message(STATUS "${family} ${count} rules, ${dfaStates} DFA states, ${states} minimized, ms:${summary}")
+
+        string(REGEX REPLACE "\n *" " " sizes "${sizes}")
+        string(APPEND json "${separator}    { \"spec\": \"${family}\", \"rules\": ${count}, \"ms\": { ${entry} }, \"sizes\": ${sizes} }")
+        set(separator ",\n")
+    endforeach()
+endforeach()
+
+string(APPEND json "\n  ],\n  \"lexers\": [")
+set(separator "\n")
+
+foreach (lexer ${lexers})
+    string(REPLACE "=" ";" lexer "${lexer}")
+    list(GET lexer 0 name)
+    list(GET lexer 1 executable)
+
+    execute_process(
+        COMMAND ${executable} ${name} ${CORPUS} ${LEXER_RUNS}
+        OUTPUT_VARIABLE line
+        OUTPUT_STRIP_TRAILING_WHITESPACE
+        RESULT_VARIABLE result
+    )
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${name} failed: ${result}")
+    endif()
+
+    string(REGEX MATCH "\"mb_per_s\": ([0-9.e+]+)" mbs "${line}")
+    set(mbs ${CMAKE_MATCH_1})
+    string(REGEX MATCH "\"tokens_per_s\": ([0-9.e+]+)" tokens "${line}")
+    set(tokens ${CMAKE_MATCH_1})
+    message(STATUS "${name}: ${mbs} MB/s, ${tokens} tokens/s")
+    string(APPEND json "${separator}    ${line}")
+    set(separator ",\n")
+endforeach()
+
+string(APPEND json "\n  ]\n}\n")
+file(WRITE ${DIR}/results.json "${json}")
+message(STATUS "Results written to ${DIR}/results.json")
@@ -0,0 +1,192 @@
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std::literals::string_literals;
+
+// Writes the specs and corpora the benchmarks run on. Everything is drawn from a fixed seed with plain modulo
+// arithmetic on std::mt19937, whose output the standard fixes, so every platform and every run gets the same bytes.
+//
+//   SpecGen lang <spec> <stubs.cpp>                a small C-like language
+//   SpecGen keywords <rules> <spec> <stubs.cpp>    <rules> - 2 keywords plus identifiers and whitespace
+//   SpecGen patterns <rules> <spec> <stubs.cpp>    <rules> - 1 distinct prefixes, each followed by digits
+//   SpecGen corpus <bytes> <file>                  text in the lang spec, about <bytes> long
+
+namespace {
+    struct Rule {
+        std::string name;
+        std::string regex;
+    };
+
+    const std::string LOWER = "abcdefghijklmnopqrstuvwxyz";
+    const std::string UPPER = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    const std::string DIGITS = "0123456789";
+
+    std::mt19937 rng(20240917);
+
+    size_t random(size_t n) { return rng() % n; }
+
+    std::string escape(char c) {
+        switch (c) {
+        case ' ':
+            return "\\s";
+        case '\n':
+            return "\\n";
+        case '\t':
+            return "\\t";
+        case '(': case ')': case '*': case '|': case '+': case '?': case '[': case ']': case '{': case '}': case '\\':
+            return "\\"s + c;
+        }
+        return std::string(1, c);
+    }
+    // (a|b|...) rather than [ab...], the way specs written before character classes spell them
+    std::string anyOf(const std::string &chars) {
+        std::string result = "(";
+        for (char c : chars)
+            result += (result.size() > 1 ? "|" : "") + escape(c);
+        return result + ")";
+    }
+    std::string printable(const std::string &except) {
+        std::string result;
+        for (char c = ' '; c <= '~'; c++)
+            if (except.find(c) == std::string::npos)
+                result += c;
+        return result;
+    }
+    std::string word(size_t minLength, size_t maxLength) {
+        std::string result;
+        for (size_t length = minLength + random(maxLength - minLength + 1); result.size() < length;)
+            result += LOWER[random(LOWER.size())];
+        return result;
+    }
+
+    std::vector<Rule> langRules() {
+        std::string idStart = LOWER + UPPER + "_", idRest = idStart + DIGITS;
+        std::string comment = printable("*") + "\n\t", commentEnd = printable("*/") + "\n\t";
+
+        return {
+            { "If", "if" }, { "Else", "else" }, { "While", "while" }, { "Return", "return" },
+            { "Id", anyOf(idStart) + anyOf(idRest) + "*" },
+            { "Num", anyOf(DIGITS) + anyOf(DIGITS) + "*" },
+            { "Ws", anyOf(" \n\t") + anyOf(" \n\t") + "*" },
+            { "Str", "\"" + anyOf(printable("\"\\")) + "*\"" },
+            { "Comment", "/\\*(" + anyOf(comment) + "|\\*\\**" + anyOf(commentEnd) + ")*\\*\\**/" },
+            { "Eq", "==" }, { "Le", "<=" }, { "Ge", ">=" }, { "Assign", "=" }, { "Lt", "<" }, { "Gt", ">" },
+            { "Plus", "\\+" }, { "Minus", "-" }, { "Star", "\\*" }, { "Slash", "/" },
+            { "LParen", "\\(" }, { "RParen", "\\)" }, { "LBrace", "\\{" }, { "RBrace", "\\}" },
+            { "Semi", ";" }, { "Comma", "," },
+        };
+    }
+    std::vector<Rule> keywordRules(size_t rules) {
+        std::vector<Rule> result;
+        std::set<std::string> seen;
+        while (result.size() + 2 < rules) {
+            std::string keyword = word(3, 10);
+            if (seen.insert(keyword).second)
+                result.push_back({ "Kw" + std::to_string(result.size()), keyword });
+        }
+        result.push_back({ "Id", anyOf(LOWER) + anyOf(LOWER + DIGITS) + "*" });
+        result.push_back({ "Ws", anyOf(" \n\t") + anyOf(" \n\t") + "*" });
+        return result;
+    }
+    std::vector<Rule> patternRules(size_t rules) {
+        std::vector<Rule> result;
+        std::set<std::string> seen;
+        while (result.size() + 1 < rules) {
+            std::string prefix = word(2, 8);
+            if (seen.insert(prefix).second)
+                result.push_back({ "Pat" + std::to_string(result.size()), prefix + anyOf(DIGITS) + anyOf(DIGITS) + "*" });
+        }
+        result.push_back({ "Ws", anyOf(" \n\t") + anyOf(" \n\t") + "*" });
+        return result;
+    }
+
+    // a run of tokens of the lang spec, each followed by whitespace so that neighbours never merge
+    std::string corpus(size_t bytes) {
+        static const char *const keywords[] = { "if", "else", "while", "return" };
+        static const char *const operators[] = { "==", "<=", ">=", "=", "<", ">", "+", "-", "*", "/", "(", ")", "{", "}", ";", "," };
+        std::string idStart = LOWER + UPPER + "_", idRest = idStart + DIGITS;
+        std::string text = printable("\"\\"), comment = LOWER + "  \n*";
+
+        std::string result;
+        result.reserve(bytes + 256);
+        while (result.size() < bytes) {
+            size_t kind = random(100);
+            if (kind < 30) {
+                result += idStart[random(idStart.size())];
+                for (size_t length = random(12); length; length--)
+                    result += idRest[random(idRest.size())];
+            }
+            else if (kind < 40)
+                result += keywords[random(4)];
+            else if (kind < 50)
+                for (size_t length = 1 + random(8); length; length--)
+                    result += DIGITS[random(DIGITS.size())];
+            else if (kind < 85)
+                result += operators[random(16)];
+            else if (kind < 95) {
+                result += '"';
+                for (size_t length = random(40); length; length--)
+                    result += text[random(text.size())];
+                result += '"';
+            }
+            else {
+                result += "/*";
+                for (size_t length = random(200); length; length--)
+                    result += comment[random(comment.size())];
+                result += "*/";
+            }
+            result += (random(8) == 0) ? '\n' : ' ';
+        }
+        return result;
+    }
+
+    void writeSpec(const std::vector<Rule> &rules, const char *specPath, const char *stubsPath) {
+        std::ofstream spec(specPath, std::ios::binary), stubs(stubsPath, std::ios::binary);
+        if (!spec || !stubs) {
+            std::cerr << "Failed to open " << specPath << " or " << stubsPath << std::endl;
+            std::exit(1);
+        }
+
+        // the generated Terminals.h declares Process for every terminal, which the owned-token lexers must define
+        stubs << "#include \"Lexer.h\"\n\n";
+        for (const Rule &rule : rules) {
+            spec << ':' << rule.name << " > " << rule.regex << '\n';
+            stubs << "bool " << rule.name << "::Process(Stack &, SymStack &, SyntaxError &) const { return false; }\n";
+        }
+    }
+    [[noreturn]] void usage() {
+        std::cerr << "Usage: SpecGen lang <spec> <stubs.cpp>\n"
+            "       SpecGen keywords|patterns <rules> <spec> <stubs.cpp>\n"
+            "       SpecGen corpus <bytes> <file>" << std::endl;
+        std::exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2)
+        usage();
+    std::string kind = argv[1];
+
+    if (kind == "lang" && argc == 4)
+        writeSpec(langRules(), argv[2], argv[3]);
+    else if (kind == "keywords" && argc == 5)
+        writeSpec(keywordRules(std::strtoul(argv[2], nullptr, 10)), argv[3], argv[4]);
+    else if (kind == "patterns" && argc == 5)
+        writeSpec(patternRules(std::strtoul(argv[2], nullptr, 10)), argv[3], argv[4]);
+    else if (kind == "corpus" && argc == 4) {
+        std::ofstream out(argv[3], std::ios::binary);
+        if (!out) {
+            std::cerr << "Failed to open " << argv[3] << std::endl;
+            return 1;
+        }
+        out << corpus(std::strtoul(argv[2], nullptr, 10));
+    }
+    else
+        usage();
+}
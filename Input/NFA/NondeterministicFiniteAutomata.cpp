@@ -1,56 +1,72 @@
 #include "NondeterministicFiniteAutomata.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <map>
+#include <tuple>
 #include <utility>
 
 using namespace nfa;
 
 
-std::vector<char> NFA::alphabet(1, '\0');
-
-NFA::NFA(char exitChar) : exitCIndex(charIndex(exitChar)) {
-    auto &state = states.emplace_back(std::make_unique<NfaState>());
-    exitState = state.get();
+NFA::NFA(char exitChar) : exitState(addState()) {
+    if (exitChar != '\0')  // '\0' stands for the empty string
+        exitLabel.set((unsigned char)exitChar);
 }
+NFA::NFA(const CharSet &exitLabel_) : exitState(addState()), exitLabel(exitLabel_) {}
 
-size_t NFA::Accepting(const std::vector<bool> &subset) const {
-    size_t result = states.size() + 1;
+size_t NFA::Accepting(const Bitset &subset) const {
+    // the lowest type wins; a simplified NFA can have fewer states than there are rules, so its size is no sentinel
+    size_t result = SIZE_MAX;
 
-    for (size_t i = 0; i < states.size(); i++) {
-        if (subset[i]) {
-            size_t acceptingType = states[i]->AcceptingType();
+    subset.ForEach([&](size_t i) {
+        size_t acceptingType = accepting[i];
 
-            if (acceptingType && acceptingType < result)
-                result = acceptingType;
-        }
-    }
+        if (acceptingType && acceptingType < result)
+            result = acceptingType;
+    });
 
-    if (result == states.size() + 1)
+    if (result == SIZE_MAX)
         return 0;
 
     return result;
 }
-std::vector<bool> &NFA::Closure(std::vector<bool> &subset) const {
-    for (size_t i = 0; i < subset.size(); i++)
-        if (subset[i])
-            closureRecursion(i, i, subset);
+Bitset &NFA::Closure(Bitset &subset) const {
+    Bitset result(accepting.size());
 
-    return subset;
+    subset.ForEach([&](size_t i) {
+        for (size_t j = closureStart[i]; j < closureStart[i + 1]; j++)
+            result.Set(closureStates[j]);
+    });
+
+    return subset = std::move(result);
+}
+Bitset NFA::Start() const {
+    Bitset start(accepting.size());
+    start.Set(0);
+    return Closure(start);
 }
-std::vector<bool> NFA::Move(const std::vector<bool> &subset, size_t cIndex) const {
-    std::vector<bool> result(states.size(), false);
+Bitset NFA::Move(const Bitset &subset, size_t cIndex) const {
+    Bitset result(accepting.size());
 
-    for (size_t i = 0; i < subset.size(); i++)
-        if (subset[i])
-            for (auto tran : states[i]->TransList(cIndex))
-                result[tran] = true;
+    subset.ForEach([&](size_t i) {
+        for (auto tran : Transitions(i, cIndex))
+            for (size_t j = closureStart[tran]; j < closureStart[tran + 1]; j++)
+                result.Set(closureStates[j]);
+    });
 
-    return Closure(result);
+    return result;
+}
+TransRange NFA::Transitions(size_t state, size_t cIndex) const {
+    auto begin = transCIndex.begin() + transStart[state], end = transCIndex.begin() + transStart[state + 1];
+    auto [first, last] = std::equal_range(begin, end, cIndex);
+
+    return { transTo.data() + (first - transCIndex.begin()), transTo.data() + (last - transCIndex.begin()) };
 }
 
 NFA NFA::Complete(NFA arg, size_t acceptingType) {
-    auto &state = arg.states.emplace_back(std::make_unique<NfaState>(acceptingType));
-    arg.exitState->Attach(arg.exitCIndex, state.get());
+    size_t state = arg.addState(acceptingType);
+    arg.attach(arg.exitState, arg.exitLabel, state);
     return arg;
 }
 NFA NFA::Concatenate(NFA lhs, NFA rhs) {
@@ -59,35 +75,52 @@ NFA NFA::Concatenate(NFA lhs, NFA rhs) {
     if (!lhs)
         return rhs;
 
-    lhs.exitState->Attach(lhs.exitCIndex, rhs.states[0].get());
-    lhs.exitState = rhs.exitState;
-    lhs.exitCIndex = rhs.exitCIndex;
-
-    lhs.states.reserve(lhs.states.size() + rhs.states.size() + 1);
-    std::move(rhs.states.begin(), rhs.states.end(), std::back_inserter(lhs.states));
+    auto [lhsOffset, rhsOffset] = unite(lhs, rhs);
+    lhs.attach(lhs.exitState + lhsOffset, lhs.exitLabel, rhs.entryState + rhsOffset);
+    lhs.entryState += lhsOffset;
+    lhs.exitState = rhs.exitState + rhsOffset;
+    lhs.exitLabel = rhs.exitLabel;
 
     return lhs;
 }
-NFA NFA::Merge(std::vector<NFA> nfas) {
-    auto in = std::make_unique<NfaState>();
-    size_t size = 1;
+NFA NFA::Merge(std::vector<NFA> nfas, bool simplify) {
+    size_t states = 1, edges = 0;
+    for (const auto &nfa : nfas) {
+        states += nfa.accepting.size();
+        edges += nfa.edges.size() + 1;
+    }
+
+    NFA result;
+    result.accepting.reserve(states);
+    result.edges.reserve(edges);
+    size_t in = result.addState();
 
     for (auto &nfa : nfas) {
-        in->Attach(EPSILON, nfa.states[0].get());
-        size += nfa.states.size();
+        size_t entry = nfa.entryState;
+        result.attach(in, {}, result.append(std::move(nfa)) + entry);
     }
 
-    NFA result;
-    result.states.reserve(size);
-    result.states.push_back(std::move(in));
+    result.computeClasses();
+    result.computeTransitions();
+    if (simplify)
+        result.simplify();
+    result.computeClosures();
+    return result;
+}
+NFA NFA::Optional(NFA arg) {
+    if (!arg)
+        return {};
 
-    for (auto &nfa : nfas)
-        std::move(nfa.states.begin(), nfa.states.end(), std::back_inserter(result.states));
+    size_t in = arg.addState(), out = arg.addState();
+    arg.attach(in, {}, arg.entryState);
+    arg.attach(in, {}, out);
+    arg.attach(arg.exitState, arg.exitLabel, out);
 
-    for (size_t i = 0; i < result.states.size(); i++)
-        result.states[i]->AssignNum(i);
+    arg.entryState = in;
+    arg.exitState = out;
+    arg.exitLabel.reset();
 
-    return result;
+    return arg;
 }
 NFA NFA::Or(NFA lhs, NFA rhs) {
     if (!rhs)
@@ -95,99 +128,281 @@ NFA NFA::Or(NFA lhs, NFA rhs) {
     if (!lhs)
         return rhs;
 
-    auto in = std::make_unique<NfaState>();
-    in->Attach(EPSILON, lhs.states[0].get());
-    in->Attach(EPSILON, rhs.states[0].get());
-
-    auto out = std::make_unique<NfaState>();
-    lhs.exitState->Attach(lhs.exitCIndex, out.get());
-    rhs.exitState->Attach(rhs.exitCIndex, out.get());
-
-    NFA result;
-    result.states.reserve(lhs.states.size() + rhs.states.size() + 3);
-    result.states.push_back(std::move(in));
+    // an alternation of single characters is a single transition on all of them
+    if (lhs.isSingleChar() && rhs.isSingleChar()) {
+        lhs.exitLabel |= rhs.exitLabel;
+        return lhs;
+    }
 
-    std::move(lhs.states.begin(), lhs.states.end(), std::back_inserter(result.states));
-    std::move(rhs.states.begin(), rhs.states.end(), std::back_inserter(result.states));
+    auto [lhsOffset, rhsOffset] = unite(lhs, rhs);
+    size_t in = lhs.addState(), out = lhs.addState();
+    lhs.attach(in, {}, lhs.entryState + lhsOffset);
+    lhs.attach(in, {}, rhs.entryState + rhsOffset);
+    lhs.attach(lhs.exitState + lhsOffset, lhs.exitLabel, out);
+    lhs.attach(rhs.exitState + rhsOffset, rhs.exitLabel, out);
 
-    result.exitState = out.get();
-    result.states.push_back(std::move(out));
-    result.exitCIndex = EPSILON;
+    lhs.entryState = in;
+    lhs.exitState = out;
+    lhs.exitLabel.reset();
 
-    return result;
+    return lhs;
 }
 NFA NFA::Plus(NFA arg) {
     if (!arg)
         return {};
 
-    auto in = std::make_unique<NfaState>();
-    in->Attach(EPSILON, arg.states[0].get());
-
-    auto out = std::make_unique<NfaState>();
-    out->Attach(EPSILON, in.get());
-    arg.exitState->Attach(arg.exitCIndex, out.get());
-
-    NFA result;
-    result.states.reserve(arg.states.size() + 3);
-    result.states.push_back(std::move(in));
-
-    std::move(arg.states.begin(), arg.states.end(), std::back_inserter(result.states));
+    size_t in = arg.addState(), out = arg.addState();
+    arg.attach(in, {}, arg.entryState);
+    arg.attach(out, {}, in);
+    arg.attach(arg.exitState, arg.exitLabel, out);
 
-    result.exitState = out.get();
-    result.states.push_back(std::move(out));
-    result.exitCIndex = EPSILON;
+    arg.entryState = in;
+    arg.exitState = out;
+    arg.exitLabel.reset();
 
-    return result;
+    return arg;
 }
 NFA NFA::Star(NFA arg) {
     if (!arg)
         return {};
 
-    auto hub = std::make_unique<NfaState>();
-    hub->Attach(EPSILON, arg.states[0].get());
-    arg.exitState->Attach(arg.exitCIndex, hub.get());
+    size_t hub = arg.addState();
+    arg.attach(hub, {}, arg.entryState);
+    arg.attach(arg.exitState, arg.exitLabel, hub);
 
-    NFA result;
-    result.states.reserve(arg.states.size() + 2);
+    arg.entryState = hub;
+    arg.exitState = hub;
+    arg.exitLabel.reset();
 
-    result.exitState = hub.get();
-    result.states.push_back(std::move(hub));
-    result.exitCIndex = EPSILON;
+    return arg;
+}
 
-    std::move(arg.states.begin(), arg.states.end(), std::back_inserter(result.states));
+size_t NFA::addState(size_t acceptingType) {
+    accepting.push_back(acceptingType);
+    return accepting.size() - 1;
+}
+size_t NFA::append(NFA &&arg) {
+    size_t offset = accepting.size();
 
-    return result;
+    accepting.insert(accepting.end(), arg.accepting.begin(), arg.accepting.end());
+    for (const auto &edge : arg.edges)
+        edges.push_back({ edge.from + offset, edge.to + offset, edge.label });
+
+    return offset;
+}
+std::pair<size_t, size_t> NFA::unite(NFA &lhs, NFA &rhs) {
+    if (lhs.accepting.size() >= rhs.accepting.size())
+        return { 0, lhs.append(std::move(rhs)) };
+
+    lhs.accepting.swap(rhs.accepting);
+    lhs.edges.swap(rhs.edges);
+    return { lhs.append(std::move(rhs)), 0 };
 }
+void NFA::computeClasses() {
+    std::unordered_set<CharSet> labels;
+    for (const auto &edge : edges)
+        if (edge.label.any())
+            labels.insert(edge.label);
 
-void NFA::closureRecursion(size_t current, size_t checked, std::vector<bool> &subset) const {
-    if (current > checked)
-        subset[current] = true;
-    else if (!subset[current] || checked == current) { // note that this fails if there is an epsilon loop
-        subset[current] = true;
+    numClasses = ByteClasses(labels, charClass);
+}
+size_t nfa::ByteClasses(const std::unordered_set<CharSet> &labels, std::vector<size_t> &charClass) {
+    // refine the partition of all bytes by every distinct label; bytes still in class 0 afterwards label nothing
+    std::vector<size_t> refined(256, 0);
+    size_t count = 1;
+    for (const auto &label : labels) {
+        std::vector<size_t> split(count, 0);
+
+        for (size_t c = 0; c < 256; c++) {
+            if (label.test(c)) {
+                if (!split[refined[c]])
+                    split[refined[c]] = count++;
+                refined[c] = split[refined[c]];
+            }
+        }
+    }
 
-        for (auto tran : states[current]->TransList(EPSILON))
-            closureRecursion(tran, checked, subset);
+    // renumber by lowest byte so that the numbering does not depend on hash order
+    std::vector<size_t> renumber(count, 0);
+    charClass.assign(256, NFA::EPSILON);
+    size_t numClasses = 1;
+    for (size_t c = 0; c < 256; c++) {
+        if (refined[c] && !renumber[refined[c]])
+            renumber[refined[c]] = numClasses++;
+        charClass[c] = renumber[refined[c]];
+    }
+    return numClasses;
+}
+void NFA::computeTransitions() {
+    std::vector<size_t> representative(numClasses);
+    for (size_t c = 256; c-- > 0;)
+        representative[charClass[c]] = c;
+
+    std::vector<std::tuple<size_t, size_t, size_t>> sorted;
+    sorted.reserve(edges.size());
+    for (const auto &edge : edges) {
+        if (edge.label.none())
+            sorted.emplace_back(edge.from, EPSILON, edge.to);
+        else
+            for (size_t cIndex = 1; cIndex < numClasses; cIndex++)
+                if (edge.label.test(representative[cIndex]))
+                    sorted.emplace_back(edge.from, cIndex, edge.to);
     }
+    std::sort(sorted.begin(), sorted.end());
+
+    transStart.assign(accepting.size() + 1, 0);
+    transCIndex.resize(sorted.size());
+    transTo.resize(sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+        size_t from;
+        std::tie(from, transCIndex[i], transTo[i]) = sorted[i];
+        transStart[from + 1]++;
+    }
+    for (size_t i = 1; i < transStart.size(); i++)
+        transStart[i] += transStart[i - 1];
+
+    edges.clear();
+    edges.shrink_to_fit();
 }
+void NFA::simplify() {
+    // The subset construction only ever lands on the start state and on the targets of labelled transitions, so
+    // only those survive, each taking over the labelled transitions and the lowest accepting type of its epsilon
+    // closure. The closures are searched one at a time rather than stored, since together they can be quadratic
+    size_t size = accepting.size();
+    std::vector<size_t> survivors{ 0 }, index(size, size);
+    index[0] = 0;
+    for (size_t i = 0; i < transTo.size(); i++) {
+        if (transCIndex[i] != EPSILON && index[transTo[i]] == size) {
+            index[transTo[i]] = survivors.size();
+            survivors.push_back(transTo[i]);
+        }
+    }
 
-size_t NFA::charIndex(char c) {
-    auto it = std::find(alphabet.begin(), alphabet.end(), c);
-    size_t index = it - alphabet.begin();
+    // row of each survivor as (class, survivor) pairs, consecutive in 'rows'
+    std::vector<std::pair<size_t, size_t>> rows;
+    std::vector<size_t> rowStart(1, 0), rowAccepting, visited(size, size), stack;
+    for (size_t s = 0; s < survivors.size(); s++) {
+        size_t type = 0;
+        stack.push_back(survivors[s]);
+        visited[survivors[s]] = s;
+
+        while (!stack.empty()) {
+            size_t current = stack.back();
+            stack.pop_back();
+            if (accepting[current] && (!type || accepting[current] < type))
+                type = accepting[current];
+
+            for (size_t j = transStart[current]; j < transStart[current + 1]; j++) {
+                if (transCIndex[j] != EPSILON)
+                    rows.emplace_back(transCIndex[j], index[transTo[j]]);
+                else if (visited[transTo[j]] != s) {
+                    visited[transTo[j]] = s;
+                    stack.push_back(transTo[j]);
+                }
+            }
+        }
 
-    if (it == alphabet.end())
-        alphabet.push_back(c);
+        std::sort(rows.begin() + rowStart.back(), rows.end());
+        rows.erase(std::unique(rows.begin() + rowStart.back(), rows.end()), rows.end());
+        rowStart.push_back(rows.size());
+        rowAccepting.push_back(type);
+    }
 
-    return index;
-}
+    // States with the same accepting type and the same transitions are equivalent. Deciding each state after its
+    // targets, in depth first postorder from the start, shares every common suffix in one pass and never reaches the
+    // states that are unreachable; a target still open on a cycle stands for itself. 'group' is the first state found
+    // with the same signature
+    size_t count = survivors.size();
+    std::vector<size_t> group(count, count), key;
+    std::vector<bool> seen(count, false);
+    std::vector<std::pair<size_t, size_t>> search{ { 0, rowStart[0] } }, pairs;
+    std::map<std::vector<size_t>, size_t> signatures;
+    seen[0] = true;
+
+    while (!search.empty()) {
+        auto &[state, next] = search.back();
+        if (next < rowStart[state + 1]) {
+            size_t to = rows[next++].second;
+            if (!seen[to]) {
+                seen[to] = true;
+                search.emplace_back(to, rowStart[to]);
+            }
+            continue;
+        }
 
+        pairs.clear();
+        for (size_t j = rowStart[state]; j < rowStart[state + 1]; j++) {
+            size_t to = rows[j].second;
+            pairs.emplace_back(rows[j].first, group[to] == count ? to : group[to]);
+        }
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+        key.assign(1, rowAccepting[state]);
+        for (const auto &[cIndex, to] : pairs) {
+            key.push_back(cIndex);
+            key.push_back(to);
+        }
+        group[state] = signatures.try_emplace(key, state).first->second;
+        search.pop_back();
+    }
 
-std::vector<size_t> NfaState::TransList(size_t cIndex) const {
-    std::vector<size_t> result;
-    result.reserve(transitions.size());
+    // number the groups breadth first from the start, which stays state 0
+    std::vector<size_t> number(count, count), order{ group[0] };
+    number[group[0]] = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        for (size_t j = rowStart[order[i]]; j < rowStart[order[i] + 1]; j++) {
+            size_t to = group[rows[j].second];
+            if (number[to] == count) {
+                number[to] = order.size();
+                order.push_back(to);
+            }
+        }
+    }
 
-    for (auto trans : transitions)
-        if (trans.cIndex == cIndex)
-            result.push_back(trans.state->stateNum);
+    accepting.clear();
+    transStart.assign(1, 0);
+    transCIndex.clear();
+    transTo.clear();
+    for (size_t state : order) {
+        pairs.clear();
+        for (size_t j = rowStart[state]; j < rowStart[state + 1]; j++)
+            pairs.emplace_back(rows[j].first, number[group[rows[j].second]]);
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+        for (const auto &[cIndex, to] : pairs) {
+            transCIndex.push_back(cIndex);
+            transTo.push_back(to);
+        }
+        transStart.push_back(transTo.size());
+        accepting.push_back(rowAccepting[state]);
+    }
+}
+void NFA::computeClosures() {
+    // depth first search from every state with an explicit stack; 'visited' holds the last state whose closure
+    // reached each state, so epsilon loops terminate and nothing needs to be cleared between searches
+    std::vector<size_t> visited(accepting.size(), accepting.size()), stack;
+    closureStart.assign(1, 0);
+    closureStates.clear();
+
+    for (size_t i = 0; i < accepting.size(); i++) {
+        stack.push_back(i);
+        visited[i] = i;
+
+        while (!stack.empty()) {
+            size_t current = stack.back();
+            stack.pop_back();
+            closureStates.push_back(current);
+
+            for (auto tran : Transitions(current, EPSILON)) {
+                if (visited[tran] != i) {
+                    visited[tran] = i;
+                    stack.push_back(tran);
+                }
+            }
+        }
 
-    return result;
+        closureStart.push_back(closureStates.size());
+    }
 }
@@ -1,11 +1,38 @@
 #ifndef NONDETERMINISTIC_FINITE_AUTOMATA_H__
 #define NONDETERMINISTIC_FINITE_AUTOMATA_H__
 
-#include <memory>
+#include "Bitset.h"
+
+#include <bitset>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace nfa {
-    class NfaState;
+    using CharSet = std::bitset<256>;
+
+    // an empty label is an epsilon transition
+    struct Edge {
+        size_t from;
+        size_t to;
+        CharSet label;
+    };
+
+    // Partitions the bytes so that each label is a union of classes. Bytes on no label share class 0, the rest are
+    // numbered from 1 by their lowest byte. Returns the number of classes.
+    size_t ByteClasses(const std::unordered_set<CharSet> &labels, std::vector<size_t> &charClass);
+
+    class TransRange {
+    public:
+        TransRange(const size_t *begin_, const size_t *end_) noexcept : first(begin_), last(end_) {}
+
+        const size_t *begin() const noexcept { return first; }
+        const size_t *end() const noexcept { return last; }
+
+    private:
+        const size_t *first;
+        const size_t *last;
+    };
 };
 
 
@@ -15,62 +42,69 @@ public:
 
     NFA() = default;
     NFA(char exitChar);
+    NFA(const nfa::CharSet &exitLabel_);
 
     NFA(NFA &&) = default;
-    NFA(const NFA &) = delete;
     NFA &operator=(NFA &&) = default;
     NFA &operator=(const NFA &) = delete;
+    // copies are only made on purpose, for repetitions that need the same fragment more than once
+    NFA Copy() const { return *this; }
 
-    size_t Accepting(const std::vector<bool> &subset) const;
-    std::vector<bool> &Closure(std::vector<bool> &subset) const;
-    std::vector<bool> Move(const std::vector<bool> &subset, size_t cIndex) const;
-    size_t Size() const noexcept { return states.size(); }
+    size_t Accepting(const Bitset &subset) const;
+    Bitset &Closure(Bitset &subset) const;
+    Bitset Start() const;
+    Bitset Move(const Bitset &subset, size_t cIndex) const;
+    nfa::TransRange Transitions(size_t state, size_t cIndex) const;
+    size_t Size() const noexcept { return accepting.size(); }
 
     static NFA Complete(NFA arg, size_t acceptingType);
     static NFA Concatenate(NFA lhs, NFA rhs);
-    static NFA Merge(std::vector<NFA> nfas);
+    // 'simplify' removes the epsilon transitions, equivalent states and unreachable states of the merged NFA
+    static NFA Merge(std::vector<NFA> nfas, bool simplify = false);
+    static NFA Optional(NFA arg);
     static NFA Or(NFA lhs, NFA rhs);
     static NFA Plus(NFA arg);
     static NFA Star(NFA arg);
 
-    static char Alphabet(size_t index) { return alphabet[index]; }
-    static size_t AlphabetSize() noexcept { return alphabet.size(); }
+    size_t AlphabetSize() const noexcept { return numClasses; }
+    const std::vector<size_t> &CharClasses() const noexcept { return charClass; }
 
 private:
-    void closureRecursion(size_t current, size_t checked, std::vector<bool> &subset) const;
-    operator bool() const noexcept { return !states.empty(); }
-
-    static size_t charIndex(char c);
-
-    std::vector<std::unique_ptr<nfa::NfaState>> states;
-    nfa::NfaState *exitState;
-    size_t exitCIndex;
-
-    static std::vector<char> alphabet;
+    NFA(const NFA &) = default;
+    operator bool() const noexcept { return !accepting.empty(); }
+    bool isSingleChar() const noexcept { return accepting.size() == 1 && edges.empty() && exitLabel.any(); }
+    size_t addState(size_t acceptingType = 0);
+    size_t append(NFA &&arg);
+    // Gathers the states of both fragments in lhs by appending the smaller store to the larger, so that building
+    // any expression copies each state O(log n) times and the chains the parser produces copy it once. Returns the
+    // offsets added to the state numbers of lhs and of rhs; the ends of both fragments are left as they were.
+    static std::pair<size_t, size_t> unite(NFA &lhs, NFA &rhs);
+    void attach(size_t from, const nfa::CharSet &label, size_t to) { edges.push_back({ from, to, label }); }
+    void computeClasses();
+    void computeTransitions();
+    void simplify();
+    void computeClosures();
+
+    // while under construction, states only exist as their accepting types and transitions as a flat edge list
+    // numbered relative to this fragment. The unary operators add their states to the fragment in place
+    std::vector<size_t> accepting;
+    std::vector<nfa::Edge> edges;
+    size_t entryState = 0;
+    size_t exitState = 0;
+    nfa::CharSet exitLabel;
+
+    // once merged, bytes that label exactly the same edges share a character class. Class EPSILON doubles as the
+    // class of bytes that appear on no edge at all, and the transitions of each state are a consecutive run sorted
+    // by class
+    std::vector<size_t> charClass;
+    size_t numClasses = 1;
+    std::vector<size_t> transStart;
+    std::vector<size_t> transCIndex;
+    std::vector<size_t> transTo;
+
+    // epsilon closure of each state, as consecutive runs of state numbers in 'closureStates'
+    std::vector<size_t> closureStart;
+    std::vector<size_t> closureStates;
 };
 
-namespace nfa {
-    struct Transition {
-        Transition(NfaState *state_, size_t cIndex_) noexcept : state(state_), cIndex(cIndex_) {}
-
-        NfaState *state;
-        size_t cIndex;
-    };
-
-    class NfaState {
-    public:
-        NfaState(size_t accepting_ = 0) noexcept : accepting(accepting_) {}
-
-        void Attach(size_t cIndex, NfaState *to) { transitions.emplace_back(to, cIndex); }
-        void AssignNum(size_t num) noexcept { stateNum = num; }
-        std::vector<size_t> TransList(size_t cIndex) const;
-        size_t AcceptingType() const noexcept { return accepting; }
-
-    private:
-        size_t accepting;
-        size_t stateNum;
-        std::vector<Transition> transitions;
-    };
-}
-
 #endif
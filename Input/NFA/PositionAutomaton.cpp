@@ -0,0 +1,226 @@
+#include "PositionAutomaton.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+
+using namespace nfa;
+
+
+PositionAutomaton::PositionAutomaton(char symbol) : nullable(symbol == '\0'), valid(true) {
+    if (symbol != '\0') {  // '\0' stands for the empty string, which has no positions
+        CharSet label;
+        label.set((unsigned char)symbol);
+        first = last = { addPosition(label) };
+    }
+}
+PositionAutomaton::PositionAutomaton(const CharSet &label) : valid(true) {
+    first = last = { addPosition(label) };
+}
+
+size_t PositionAutomaton::Accepting(const Bitset &subset) const {
+    size_t result = SIZE_MAX;
+
+    subset.ForEach([&](size_t i) {
+        size_t acceptingType = accepting[i];
+
+        if (acceptingType && acceptingType < result)
+            result = acceptingType;
+    });
+
+    if (result == SIZE_MAX)
+        return 0;
+
+    return result;
+}
+Bitset PositionAutomaton::Start() const {
+    Bitset start(labels.size());
+    for (size_t position : first)
+        start.Set(position);
+    return start;
+}
+Bitset PositionAutomaton::Move(const Bitset &subset, size_t cIndex) const {
+    Bitset result(labels.size());
+    size_t c = representative[cIndex];
+
+    subset.ForEach([&](size_t i) {
+        if (labels[i].test(c))
+            for (size_t j = followStart[i]; j < followStart[i + 1]; j++)
+                result.Set(followPositions[j]);
+    });
+
+    return result;
+}
+
+PositionAutomaton PositionAutomaton::Complete(PositionAutomaton arg, size_t acceptingType) {
+    size_t marker = arg.addPosition({}, acceptingType);
+    arg.link(arg.last, { marker });
+    if (arg.nullable)
+        arg.first.push_back(marker);
+
+    arg.last = { marker };
+    arg.nullable = false;
+    arg.valid = true;
+    return arg;
+}
+PositionAutomaton PositionAutomaton::Concatenate(PositionAutomaton lhs, PositionAutomaton rhs) {
+    if (!rhs)
+        return lhs;
+    if (!lhs)
+        return rhs;
+
+    auto [lhsOffset, rhsOffset] = unite(lhs, rhs);
+    shift(lhs.first, lhsOffset);
+    shift(lhs.last, lhsOffset);
+    shift(rhs.first, rhsOffset);
+    shift(rhs.last, rhsOffset);
+
+    lhs.link(lhs.last, rhs.first);
+    if (lhs.nullable)
+        join(lhs.first, std::move(rhs.first));
+    if (rhs.nullable)
+        join(rhs.last, std::move(lhs.last));
+    lhs.last = std::move(rhs.last);
+    lhs.nullable = lhs.nullable && rhs.nullable;
+
+    return lhs;
+}
+PositionAutomaton PositionAutomaton::Merge(std::vector<PositionAutomaton> rules) {
+    size_t positions = 0, follows = 0;
+    for (const auto &rule : rules) {
+        positions += rule.labels.size();
+        follows += rule.follows.size();
+    }
+
+    PositionAutomaton result;
+    result.labels.reserve(positions);
+    result.accepting.reserve(positions);
+    result.follows.reserve(follows);
+
+    for (auto &rule : rules) {
+        std::vector<size_t> first = std::move(rule.first);
+        size_t offset = result.append(std::move(rule));
+        for (size_t position : first)
+            result.first.push_back(position + offset);
+    }
+    result.valid = true;
+
+    result.computeClasses();
+    result.computeFollows();
+    return result;
+}
+PositionAutomaton PositionAutomaton::Optional(PositionAutomaton arg) {
+    if (!arg)
+        return {};
+
+    arg.nullable = true;
+    return arg;
+}
+PositionAutomaton PositionAutomaton::Or(PositionAutomaton lhs, PositionAutomaton rhs) {
+    if (!rhs)
+        return lhs;
+    if (!lhs)
+        return rhs;
+
+    // an alternation of single characters is a single position on all of them
+    if (lhs.isSingleChar() && rhs.isSingleChar()) {
+        lhs.labels[0] |= rhs.labels[0];
+        return lhs;
+    }
+
+    auto [lhsOffset, rhsOffset] = unite(lhs, rhs);
+    shift(lhs.first, lhsOffset);
+    shift(lhs.last, lhsOffset);
+    shift(rhs.first, rhsOffset);
+    shift(rhs.last, rhsOffset);
+
+    join(lhs.first, std::move(rhs.first));
+    join(lhs.last, std::move(rhs.last));
+    lhs.nullable = lhs.nullable || rhs.nullable;
+
+    return lhs;
+}
+PositionAutomaton PositionAutomaton::Plus(PositionAutomaton arg) {
+    if (!arg)
+        return {};
+
+    arg.link(arg.last, arg.first);
+    return arg;
+}
+PositionAutomaton PositionAutomaton::Star(PositionAutomaton arg) {
+    if (!arg)
+        return {};
+
+    arg.link(arg.last, arg.first);
+    arg.nullable = true;
+    return arg;
+}
+
+size_t PositionAutomaton::addPosition(const CharSet &label, size_t acceptingType) {
+    labels.push_back(label);
+    accepting.push_back(acceptingType);
+    return labels.size() - 1;
+}
+size_t PositionAutomaton::append(PositionAutomaton &&arg) {
+    size_t offset = labels.size();
+
+    labels.insert(labels.end(), arg.labels.begin(), arg.labels.end());
+    accepting.insert(accepting.end(), arg.accepting.begin(), arg.accepting.end());
+    for (const auto &follow : arg.follows)
+        follows.emplace_back(follow.first + offset, follow.second + offset);
+
+    return offset;
+}
+std::pair<size_t, size_t> PositionAutomaton::unite(PositionAutomaton &lhs, PositionAutomaton &rhs) {
+    if (lhs.labels.size() >= rhs.labels.size())
+        return { 0, lhs.append(std::move(rhs)) };
+
+    lhs.labels.swap(rhs.labels);
+    lhs.accepting.swap(rhs.accepting);
+    lhs.follows.swap(rhs.follows);
+    return { lhs.append(std::move(rhs)), 0 };
+}
+void PositionAutomaton::shift(std::vector<size_t> &positions, size_t offset) {
+    if (offset)
+        for (size_t &position : positions)
+            position += offset;
+}
+void PositionAutomaton::join(std::vector<size_t> &into, std::vector<size_t> &&from) {
+    if (into.size() < from.size())
+        into.swap(from);
+    into.insert(into.end(), from.begin(), from.end());
+}
+void PositionAutomaton::link(const std::vector<size_t> &from, const std::vector<size_t> &to) {
+    for (size_t i : from)
+        for (size_t j : to)
+            follows.emplace_back(i, j);
+}
+void PositionAutomaton::computeClasses() {
+    std::unordered_set<CharSet> distinct;
+    for (const auto &label : labels)
+        if (label.any())
+            distinct.insert(label);
+
+    numClasses = ByteClasses(distinct, charClass);
+
+    representative.assign(numClasses, 0);
+    for (size_t c = 256; c-- > 0;)
+        representative[charClass[c]] = c;
+}
+void PositionAutomaton::computeFollows() {
+    // nested stars link the same positions more than once
+    std::sort(follows.begin(), follows.end());
+    follows.erase(std::unique(follows.begin(), follows.end()), follows.end());
+
+    followStart.assign(labels.size() + 1, 0);
+    followPositions.resize(follows.size());
+    for (size_t i = 0; i < follows.size(); i++) {
+        followStart[follows[i].first + 1]++;
+        followPositions[i] = follows[i].second;
+    }
+    for (size_t i = 1; i < followStart.size(); i++)
+        followStart[i] += followStart[i - 1];
+
+    follows.clear();
+    follows.shrink_to_fit();
+}
@@ -0,0 +1,79 @@
+#ifndef POSITION_AUTOMATON_H__
+#define POSITION_AUTOMATON_H__
+
+#include "Bitset.h"
+#include "NondeterministicFiniteAutomata.h"
+
+#include <utility>
+#include <vector>
+
+
+// Position (Glushkov) automaton of a regular expression: one state per character position of the expression, with
+// followpos as its transitions. Fragments are built bottom up by the same combinators as NFA from their nullable,
+// firstpos and lastpos, so the subset construction runs on it directly without any epsilon closures. Completing a
+// rule adds an end marker position that carries its accepting type, and Merge unions the firstpos of every rule.
+class PositionAutomaton {
+public:
+    PositionAutomaton() = default;
+    PositionAutomaton(char symbol);
+    PositionAutomaton(const nfa::CharSet &label);
+
+    PositionAutomaton(PositionAutomaton &&) = default;
+    PositionAutomaton &operator=(PositionAutomaton &&) = default;
+    PositionAutomaton &operator=(const PositionAutomaton &) = delete;
+    // copies are only made on purpose, for repetitions that need the same fragment more than once
+    PositionAutomaton Copy() const { return *this; }
+
+    size_t Accepting(const Bitset &subset) const;
+    Bitset Start() const;
+    Bitset Move(const Bitset &subset, size_t cIndex) const;
+    size_t Size() const noexcept { return labels.size(); }
+
+    static PositionAutomaton Complete(PositionAutomaton arg, size_t acceptingType);
+    static PositionAutomaton Concatenate(PositionAutomaton lhs, PositionAutomaton rhs);
+    static PositionAutomaton Merge(std::vector<PositionAutomaton> rules);
+    static PositionAutomaton Optional(PositionAutomaton arg);
+    static PositionAutomaton Or(PositionAutomaton lhs, PositionAutomaton rhs);
+    static PositionAutomaton Plus(PositionAutomaton arg);
+    static PositionAutomaton Star(PositionAutomaton arg);
+
+    size_t AlphabetSize() const noexcept { return numClasses; }
+    const std::vector<size_t> &CharClasses() const noexcept { return charClass; }
+
+private:
+    PositionAutomaton(const PositionAutomaton &) = default;
+    operator bool() const noexcept { return valid; }
+    bool isSingleChar() const noexcept { return labels.size() == 1 && follows.empty() && !nullable && !accepting[0]; }
+    size_t addPosition(const nfa::CharSet &label, size_t acceptingType = 0);
+    size_t append(PositionAutomaton &&arg);
+    // as NFA::unite: gathers the positions of both fragments in lhs, appending the smaller store to the larger, and
+    // returns the offsets added to the positions of lhs and of rhs, whose lists are left as they were
+    static std::pair<size_t, size_t> unite(PositionAutomaton &lhs, PositionAutomaton &rhs);
+    static void shift(std::vector<size_t> &positions, size_t offset);
+    // appends the shorter list to the longer one, leaving the result in 'into'
+    static void join(std::vector<size_t> &into, std::vector<size_t> &&from);
+    void link(const std::vector<size_t> &from, const std::vector<size_t> &to);
+    void computeClasses();
+    void computeFollows();
+
+    // label and accepting type of every position; end markers have an empty label and a nonzero type
+    std::vector<nfa::CharSet> labels;
+    std::vector<size_t> accepting;
+
+    // while under construction, followpos is a flat list of pairs numbered relative to this fragment
+    std::vector<std::pair<size_t, size_t>> follows;
+    std::vector<size_t> first;
+    std::vector<size_t> last;
+    bool nullable = false;
+    bool valid = false;
+
+    // once merged, 'first' holds the start positions and followpos of each position is a consecutive sorted run
+    // in 'followPositions'
+    std::vector<size_t> charClass;
+    size_t numClasses = 1;
+    std::vector<size_t> representative;
+    std::vector<size_t> followStart;
+    std::vector<size_t> followPositions;
+};
+
+#endif
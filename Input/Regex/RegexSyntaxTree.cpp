@@ -1,5 +1,6 @@
 #include "RegexSyntaxTree.h"
 
+#include <cstdint>
 #include <utility>
 #include <vector>
 
@@ -13,6 +14,9 @@ namespace synTree {
 
         char Char() const;
         bool IsChar() const { return **this == '\0'; }
+        bool IsAtom() const { return **this == '(' || **this == '[' || IsChar(); }
+        // the character as written, which is '\\' for any escape
+        char Raw() const { return *it; }
 
         Iterator &operator++();
         Iterator operator++(int);
@@ -24,71 +28,162 @@ namespace synTree {
         std::string::const_iterator it;
     };
 
-    class Terminal : public Node {
-    public:
-        Terminal(char symbol_) noexcept : symbol(symbol_) {}
-        NFA GenNfa(NFA) const { return symbol; }
-    private:
-        char symbol;
-    };
-    class NonTerminal : public Node {
-    protected:
-        std::vector<std::unique_ptr<Node>> nodes;
-    };
+    nfa::CharSet CharClass(Iterator &it, Iterator end);
+    std::uint32_t Count(Iterator &it, Iterator end);
+}
 
-    class Q : public NonTerminal {
-    public:
-        Q(Iterator &it, Iterator end);
-        NFA GenNfa(NFA nfa) const;
-    };
-    class R : public NonTerminal {
-    public:
-        R(Iterator &it, Iterator end);
-        NFA GenNfa(NFA nfa) const;
-    };
-    class S : public NonTerminal {
-    public:
-        S(Iterator &it, Iterator end);
-        NFA GenNfa(NFA nfa) const;
-    };
-    class T : public NonTerminal {
-    public:
-        T(Iterator &it, Iterator end);
-        NFA GenNfa(NFA nfa) const;
-    };
-    class U : public NonTerminal {
-    public:
-        U(Iterator &it, Iterator end);
-        NFA GenNfa(NFA nfa) const;
+
+Tree::Tree(const std::string &input) {
+    // a trailing backslash escapes nothing
+    size_t backslashes = 0;
+    for (auto c = input.rbegin(); c != input.rend() && *c == '\\'; c++)
+        backslashes++;
+    if (backslashes % 2)
+        throw RegexParserError("Invalid syntax", ERROR_LOC());
+
+    // Operands and postfix operators go straight to the output, while '|', '.' for concatenation and '(' wait in
+    // 'pending' for their right hand side. Concatenation is left associative and alternation right associative, so
+    // a|b|c is a|(b|c), and either has to wait only for the concatenations before it
+    std::vector<char> pending;
+    bool operand = false;  // whether the input read so far ends in a complete operand
+    nodes.reserve(2 * input.size());
+
+    auto emit = [&](Kind kind, std::uint32_t value = 0, std::uint32_t max = 0) {
+        nodes.push_back({ kind, value, max });
     };
-    class V : public NonTerminal {
-    public:
-        V(Iterator &it, Iterator end);
-        NFA GenNfa(NFA nfa) const;
+    auto push = [&](char op) {
+        for (; !pending.empty() && pending.back() == '.'; pending.pop_back())
+            emit(Kind::Concat);
+        pending.push_back(op);
     };
-    class W : public NonTerminal {
-    public:
-        W(Iterator &it, Iterator end);
-        NFA GenNfa(NFA nfa) const;
+    auto unwind = [&]() {
+        for (; !pending.empty() && pending.back() != '('; pending.pop_back())
+            emit(pending.back() == '.' ? Kind::Concat : Kind::Alt);
     };
-}
-
 
-Tree::Tree(const std::string &input) {
     Iterator it = input.begin(), end = input.end();
+    while (it != end) {
+        if (it.IsAtom()) {
+            if (operand)
+                push('.');
 
-    if (it == end)
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-    else if (*it == '(' || it.IsChar()) {
-        node = std::make_unique<Q>(it, end);
-
-        if (it != end)
+            operand = *it != '(';
+            if (*it == '(')
+                pending.push_back('(');
+            else if (*it == '[') {
+                labels.push_back(CharClass(++it, end));
+                emit(Kind::Class, (std::uint32_t)labels.size() - 1);
+            }
+            else
+                emit(Kind::Char, (unsigned char)it.Char());
+            it++;
+        }
+        else if (!operand)
             throw RegexParserError("Invalid syntax", ERROR_LOC());
+        else if (*it == '|') {
+            push('|');
+            operand = false;
+            it++;
+        }
+        else if (*it == ')') {
+            unwind();
+            if (pending.empty())
+                throw RegexParserError("Invalid syntax", ERROR_LOC());
+            pending.pop_back();
+            it++;
+        }
+        else if (*it == '{') {
+            // {m}, {m,} or {m,n}
+            std::uint32_t min = Count(++it, end), max = min;
+            if (it != end && it.Raw() == ',') {
+                it++;
+                max = (it != end && it.Raw() == '}') ? UNBOUNDED : Count(it, end);
+            }
+            if (it == end || it.Raw() != '}' || min > max)
+                throw RegexParserError("Invalid repetition", ERROR_LOC());
+            emit(Kind::Repeat, min, max);
+            it++;
+        }
+        else {
+            // the operators apply left to right, so a*? is (a*)?
+            emit(*it == '*' ? Kind::Star : *it == '+' ? Kind::Plus : Kind::Optional);
+            it++;
+        }
     }
-    else
+
+    unwind();
+    if (!operand || !pending.empty())
         throw RegexParserError("Invalid syntax", ERROR_LOC());
 }
 
+NFA Tree::GenNfa(size_t acceptingType) const {
+    return NFA::Complete(lower<NFA>(), acceptingType);
+}
+PositionAutomaton Tree::GenPositions(size_t acceptingType) const {
+    return PositionAutomaton::Complete(lower<PositionAutomaton>(), acceptingType);
+}
+
+template <typename A> A Tree::lower() const {
+    // every operator replaces its operands on top of the stack with the fragment it builds from them
+    std::vector<A> fragments;
+
+    for (const Node &node : nodes) {
+        switch (node.kind) {
+        case Kind::Char:
+            fragments.emplace_back((char)node.value);
+            break;
+        case Kind::Class:
+            fragments.emplace_back(labels[node.value]);
+            break;
+        case Kind::Concat:
+        case Kind::Alt: {
+            A rhs = std::move(fragments.back());
+            fragments.pop_back();
+            A &lhs = fragments.back();
+            if (node.kind == Kind::Concat)
+                lhs = A::Concatenate(std::move(lhs), std::move(rhs));
+            else
+                lhs = A::Or(std::move(lhs), std::move(rhs));
+            break;
+        }
+        case Kind::Star:
+            fragments.back() = A::Star(std::move(fragments.back()));
+            break;
+        case Kind::Plus:
+            fragments.back() = A::Plus(std::move(fragments.back()));
+            break;
+        case Kind::Optional:
+            fragments.back() = A::Optional(std::move(fragments.back()));
+            break;
+        case Kind::Repeat:
+            fragments.back() = repeat(std::move(fragments.back()), node.value, node.max);
+            break;
+        }
+    }
+
+    return std::move(fragments.back());
+}
+template <typename A> A Tree::repeat(A arg, std::uint32_t min, std::uint32_t max) {
+    // x{2,4} is xx(x(x)?)?, which nests the optional copies rather than offering them side by side
+    A result;
+    for (std::uint32_t i = 0; i < min; i++)
+        result = A::Concatenate(std::move(result), arg.Copy());
+
+    if (max == UNBOUNDED)
+        result = A::Concatenate(std::move(result), A::Star(std::move(arg)));
+    else {
+        A tail;
+        for (std::uint32_t i = min; i < max; i++)
+            tail = A::Optional(A::Concatenate(arg.Copy(), std::move(tail)));
+        result = A::Concatenate(std::move(result), std::move(tail));
+    }
+
+    // x{0} and x{0,0} match only the empty string
+    if (min == 0 && max == 0)
+        return A('\0');
+    return result;
+}
+
 char Iterator::Char() const {
     if (*it == '\\') {
         char c = *(it + 1);
@@ -109,7 +204,7 @@ char Iterator::Char() const {
 }
 char Iterator::operator*() const {
     char c = *it;
-    if (c == '(' || c == ')' || c == '*' || c == '|')
+    if (c == '(' || c == ')' || c == '*' || c == '|' || c == '+' || c == '?' || c == '[' || c == '{')
         return c;
 
     return '\0';
@@ -127,117 +222,50 @@ Iterator Iterator::operator++(int) {
     return temp;
 }
 
-Q::Q(Iterator &it, Iterator end) {
-    if (it == end)
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-    else if (*it == '(' || it.IsChar()) {
-        nodes.push_back(std::make_unique<S>(it, end));
-        nodes.push_back(std::make_unique<R>(it, end));
-    }
-    else
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-}
-R::R(Iterator &it, Iterator end) {
-    if (it == end || *it == ')');
-    else if (*it == '|') {
-        it++;
-        nodes.push_back(std::make_unique<Terminal>('|'));
-        nodes.push_back(std::make_unique<S>(it, end));
-        nodes.push_back(std::make_unique<R>(it, end));
-    }
-    else
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-}
-S::S(Iterator &it, Iterator end) {
-    if (it == end)
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-    else if (*it == '(' || it.IsChar()) {
-        nodes.push_back(std::make_unique<U>(it, end));
-        nodes.push_back(std::make_unique<T>(it, end));
-    }
-    else
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-}
-T::T(Iterator &it, Iterator end) {
-    if (it == end || *it == '|' || *it == ')');
-    else if (*it == '(' || it.IsChar()) {
-        nodes.push_back(std::make_unique<U>(it, end));
-        nodes.push_back(std::make_unique<T>(it, end));
-    }
-    else
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-}
-U::U(Iterator &it, Iterator end) {
-    if (it == end)
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-    else if (*it == '(' || it.IsChar()) {
-        nodes.push_back(std::make_unique<W>(it, end));
-        nodes.push_back(std::make_unique<V>(it, end));
-    }
-    else
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-}
-V::V(Iterator &it, Iterator end) {
-    if (it == end || *it == '|' || *it == '(' || *it == ')' || it.IsChar());
-    else if (*it == '*') {
-        it++;
-        nodes.push_back(std::make_unique<Terminal>('*'));
-        nodes.push_back(std::make_unique<V>(it, end));
-    }
-    else
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-}
-W::W(Iterator &it, Iterator end) {
-    if (it == end)
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-    else if (it.IsChar()) {
-        nodes.push_back(std::make_unique<Terminal>(it.Char()));
-        it++;
-    }
-    else if (*it == '(') {
-        it++;
-        nodes.push_back(std::make_unique<Terminal>('('));
-        nodes.push_back(std::make_unique<Q>(it, end));
+nfa::CharSet synTree::CharClass(Iterator &it, Iterator end) {
+    nfa::CharSet label;
 
-        if (it != end && *it == ')')
-            nodes.push_back(std::make_unique<Terminal>(')'));
-        else
-            throw RegexParserError("Invalid syntax", ERROR_LOC());
+    // every character but an unescaped ']' stands for itself, and '-' between two characters spans a range
+    bool negate = it != end && it.Raw() == '^';
+    if (negate)
+        it++;
 
+    while (it != end && it.Raw() != ']') {
+        unsigned char first = (unsigned char)it.Char(), last = first;
+        if (first == '\0')
+            throw RegexParserError("Invalid character class", ERROR_LOC());
         it++;
+
+        Iterator next = it;
+        if (it != end && it.Raw() == '-' && ++next != end && next.Raw() != ']') {
+            last = (unsigned char)next.Char();
+            if (last == '\0' || last < first)
+                throw RegexParserError("Invalid character class", ERROR_LOC());
+            it = ++next;
+        }
+        for (size_t c = first; c <= last; c++)
+            label.set(c);
     }
-    else
-        throw RegexParserError("Invalid syntax", ERROR_LOC());
-}
 
-NFA Q::GenNfa(NFA) const {
-    return nodes[1]->GenNfa(nodes[0]->GenNfa());
-}
-NFA R::GenNfa(NFA nfa) const {
-    if (nodes.empty())
-        return nfa;
-    return NFA::Or(std::move(nfa), nodes[2]->GenNfa(nodes[1]->GenNfa()));
-}
-NFA S::GenNfa(NFA) const {
-    return nodes[1]->GenNfa(nodes[0]->GenNfa());
-}
-NFA T::GenNfa(NFA nfa) const {
-    if (nodes.empty())
-        return nfa;
-    return nodes[1]->GenNfa(NFA::Concatenate(std::move(nfa), nodes[0]->GenNfa()));
-}
-NFA U::GenNfa(NFA) const {
-    return nodes[1]->GenNfa(nodes[0]->GenNfa());
-}
-NFA V::GenNfa(NFA nfa) const {
-    if (nodes.empty())
-        return nfa;
-    return NFA::Star(nodes[1]->GenNfa(std::move(nfa)));
+    if (it == end)
+        throw RegexParserError("Invalid character class", ERROR_LOC());
+    if (negate)
+        label.flip();
+    if (label.none())
+        throw RegexParserError("Empty character class", ERROR_LOC());
+    return label;
 }
-NFA W::GenNfa(NFA) const {
-    if (nodes.size() == 1)
-        return nodes[0]->GenNfa();
-    return nodes[1]->GenNfa();
+std::uint32_t synTree::Count(Iterator &it, Iterator end) {
+    std::uint32_t value = 0;
+    bool any = false;
+    for (; it != end && it.Raw() >= '0' && it.Raw() <= '9'; it++, any = true) {
+        value = value * 10 + (it.Raw() - '0');
+        if (value > Tree::MAX_REPEAT)
+            throw RegexParserError("Repetition count too large", ERROR_LOC());
+    }
+    if (!any)
+        throw RegexParserError("Invalid repetition", ERROR_LOC());
+    return value;
 }
 
 std::string RegexParserError::createMessage(const std::string &msg, ErrorLoc loc) {
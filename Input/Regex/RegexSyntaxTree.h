@@ -3,30 +3,48 @@
 
 #include "ErrorLoc.h"
 #include "NondeterministicFiniteAutomata.h"
+#include "PositionAutomaton.h"
 
+#include <cstdint>
 #include <exception>
-#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 
 namespace synTree {
-    class Node {
-    public:
-        virtual NFA GenNfa(NFA nfa = {}) const = 0;
-        virtual ~Node() = default;
+    enum class Kind : std::uint8_t { Char, Class, Concat, Alt, Star, Plus, Optional, Repeat };
+
+    // One node of the tree in postfix order, so every operator follows its operands and the tree needs no links
+    struct Node {
+        Kind kind;
+        std::uint32_t value;  // the character of Char ('\0' for the empty string), label index of Class, min of Repeat
+        std::uint32_t max;    // of Repeat
     };
 }
 
+// Abstract syntax tree of a regular expression, flattened into postfix order in one array of small nodes. It is parsed
+// by operator precedence and lowered to an automaton by a single pass over the array with a stack of fragments, so
+// neither recursion nor the depth of the expression is limited by the call stack.
 class Tree {
 public:
+    // bounded repetitions are spelled out copy by copy, so their counts are capped
+    static constexpr std::uint32_t MAX_REPEAT = 1000;
+    static constexpr std::uint32_t UNBOUNDED = UINT32_MAX;
+
     Tree() = default;
     explicit Tree(const std::string &input);
 
-    NFA GenNfa(size_t acceptingType) const { return NFA::Complete(node->GenNfa(), acceptingType); }
-    operator bool() const noexcept { return (bool)node; }
+    NFA GenNfa(size_t acceptingType) const;
+    PositionAutomaton GenPositions(size_t acceptingType) const;
+    operator bool() const noexcept { return !nodes.empty(); }
 
 private:
-    std::unique_ptr<synTree::Node> node;
+    template <typename A> A lower() const;
+    template <typename A> static A repeat(A arg, std::uint32_t min, std::uint32_t max);
+
+    std::vector<synTree::Node> nodes;
+    std::vector<nfa::CharSet> labels;
 };
 
 class RegexParserError : public std::runtime_error {
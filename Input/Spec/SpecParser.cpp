@@ -0,0 +1,87 @@
+#include "SpecParser.h"
+
+#include "RegexSyntaxTree.h"
+
+#include <sstream>
+
+
+bool Parser::ParseInput() {
+    // the lines are split in order, which also fixes every rule's accepting type; after that the regular expressions
+    // have nothing to share
+    std::vector<std::string> regExes;
+    for (std::string regEx; readLine(regEx);)
+        regExes.push_back(std::move(regEx));
+
+    if (!error.empty())
+        return false;
+    if (regExes.empty()) {
+        error = "Input file is empty!";
+        return false;
+    }
+
+    if (direct)
+        positions.resize(regExes.size());
+    else
+        nfas.resize(regExes.size());
+    std::vector<std::string> errors(regExes.size());
+    auto build = [&](size_t i) {
+        try {
+            if (direct)
+                positions[i] = Tree(regExes[i]).GenPositions(i + 1);
+            else
+                nfas[i] = Tree(regExes[i]).GenNfa(i + 1);
+        }
+        catch (const RegexParserError &err) {
+            errors[i] = err.what();
+        }
+    };
+    if (pool)
+        pool->ForEach(regExes.size(), build);
+    else
+        for (size_t i = 0; i < regExes.size(); i++)
+            build(i);
+
+    // the first broken rule is the one reported, whichever thread got to it first
+    for (std::string &err : errors) {
+        if (!err.empty()) {
+            error = std::move(err);
+            return false;
+        }
+    }
+
+    return true;
+}
+bool Parser::readLine(std::string &regEx) {
+    std::string line;
+
+    if (!std::getline(*in, line))
+        return false;
+
+    return parseLine(line, regEx);
+}
+bool Parser::parseLine(const std::string &str, std::string &regEx) {
+    std::stringstream stream(str);
+
+    if (stream.get() != ':')
+        return fail("Lines must begin with :");
+
+    std::string word;
+    if (!(stream >> word))
+        return fail("Expected Terminal name after : in " + str);
+    types.push_back(std::move(word));
+
+    if (!(stream >> word) || word != ">")
+        return fail("Expected > after Terminal in " + str);
+
+    if (!(stream >> regEx))
+        return fail("Expected regular expression after Terminal name in " + str);
+
+    if (stream >> word)
+        return fail("Unexpected text after regular expression in " + str);
+
+    return true;
+}
+bool Parser::fail(std::string message) {
+    error = std::move(message);
+    return false;
+}
@@ -0,0 +1,45 @@
+#ifndef SPEC_PARSER_H__
+#define SPEC_PARSER_H__
+
+#include "NondeterministicFiniteAutomata.h"
+#include "PositionAutomaton.h"
+#include "ThreadPool.h"
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Reads a spec, one rule per line in the form ":Name > regex", and builds an automaton for every rule. A rule's
+// accepting type is its line number, counting from 1. Errors are reported through GetError rather than thrown.
+class Parser {
+public:
+    // with a pool the rules are parsed and turned into automata concurrently, in any order. 'direct' builds position
+    // automata instead of NFAs
+    Parser(std::istream &in_, ThreadPool *pool_ = nullptr, bool direct_ = false) : in(&in_), pool(pool_), direct(direct_) {}
+    bool ParseInput();
+    std::vector<NFA> GetNFAs() { return std::move(nfas); }
+    std::vector<PositionAutomaton> GetPositions() { return std::move(positions); }
+    std::vector<std::string> GetTypes() { return std::move(types); }
+    std::string GetError() { return std::move(error); }
+
+    Parser(Parser &&) = default;
+    Parser(const Parser &) = delete;
+    Parser &operator=(Parser &&) = default;
+    Parser &operator=(const Parser &) = delete;
+private:
+    bool readLine(std::string &regEx);
+    bool parseLine(const std::string &str, std::string &regEx);
+    bool fail(std::string message);
+
+    std::istream *in;
+    ThreadPool *pool;
+    bool direct;
+    std::vector<NFA> nfas;
+    std::vector<PositionAutomaton> positions;
+    std::vector<std::string> types;
+    std::string error;
+};
+
+#endif
@@ -1,16 +1,28 @@
+#include "DfaFormat.h"
 #include "NondeterministicFiniteAutomata.h"
+#include "PositionAutomaton.h"
 #include "RegexSyntaxTree.h"
+#include "SpecParser.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 
 #include <algorithm>
 #include <iostream>
+#include <map>
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <memory>
-#include <chrono>
+#include <set>
 #include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
 
 using namespace std::literals::string_literals;
 using std::move;
@@ -21,346 +33,899 @@ using std::vector;
 // char index 0 is reserved for epsilon transition
 
 std::string ToUpper(const std::string &src);
+std::string CharLiteral(char c);
 
 class DFA
 {
 public:
-    DFA(const NFA &nfa);
+    // Automaton is an NFA or a PositionAutomaton. Without a pool the subset construction runs on the calling thread;
+    // either way it numbers the states the same
+    template <typename Automaton> DFA(const Automaton &automaton, ThreadPool *pool = nullptr);
     DFA(const DFA &) = delete;
     DFA(DFA &&) = default;
     DFA &operator=(const DFA &) = delete;
     DFA &operator=(DFA &&) = default;
     static DFA Optimize(const DFA &dfa);
+    // Load returns null unless the stream holds a well formed DFA written by Save for 'numTypes' terminals
+    static std::unique_ptr<DFA> Load(std::istream &in, size_t numTypes);
+    void Save(std::ostream &out) const;
+    // the file image of the DFA in the binary format of DfaFormat.h, named with 'types'
+    std::string SaveBinary(const std::vector<std::string> &types) const;
+    // true if a joint walk over all bytes pairs every state with exactly one state of 'other' of the same accepting
+    // type; for minimized DFAs that is the case exactly when they recognize the same tokens
+    bool Isomorphic(const DFA &other) const;
+    // true if a joint walk over all bytes from both start states only pairs states of the same accepting type, so both
+    // DFAs recognize the same tokens whatever their sizes
+    bool Equivalent(const DFA &other) const;
+    // true if no two states, nor any state and the missing dead state, accept the same tokens; decided by Moore's
+    // refinement, which is slow but simple enough to check Optimize against
+    bool Minimal() const;
 
     size_t Size() const { return stateInfo.size(); }
+    size_t AlphabetSize() const { return numClasses; }
+    const std::vector<size_t> &CharClasses() const { return charClass; }
     std::tuple<size_t, std::vector<size_t>> operator[](size_t state) const { return { stateInfo[state].accepting, move(stateInfo[state].transitions) }; }
 private:
     DFA() = default;
-    static bool isNonempty(const std::vector<bool> &subset);
 
     struct StateInfo
     {
+        StateInfo(size_t numClasses) : transitions(numClasses, 0) {}
         size_t accepting = 0;
-        vector<size_t> transitions = vector<size_t>(NFA::AlphabetSize(), NFA::EPSILON);
+        vector<size_t> transitions;
     };
     vector<StateInfo> stateInfo;
+    vector<size_t> charClass;
+    size_t numClasses;
 };
 
 class CodeGen
 {
 public:
-    CodeGen(const DFA &dfa);
+    // Direct emits every state as a labelled block of one scan function; Table emits a transition table and a loop
+    enum class Backend { Direct, Table };
+    enum class TokenMode { Owned, View };
+    struct Config
+    {
+        Backend backend = Backend::Direct;
+        TokenMode tokens = TokenMode::Owned;
+        bool stream = false;
+        bool parallel = false;
+        bool simd = false;
+    };
+
+    CodeGen(const DFA &dfa, std::vector<std::string> types_, const Config &config_);
 
     CodeGen(const CodeGen &) = delete;
     CodeGen(CodeGen &&) = delete;
     CodeGen &operator=(const CodeGen &) = delete;
     CodeGen &operator=(CodeGen &&) = delete;
 
-    static void AddType(std::string &&name);
     void PrintStates(std::ostream &out) const;
     void PrintClass(std::ostream &out) const;
     void PrintTerminals(std::ostream &out) const;
     void PrintDefinitions(std::ostream &out) const;
     void PrintSymHeader(std::ostream &out) const;
 private:
+    void printTables(std::ostream &out) const;
+    void printScan(std::ostream &out) const;
+    void printDirectScan(std::ostream &out) const;
+    void printTypeEnum(std::ostream &out) const;
+    void printMakeToken(std::ostream &out) const;
+    void printParallel(std::ostream &out) const;
+    void printStreamClass(std::ostream &out) const;
+    void printStreamDefinitions(std::ostream &out) const;
+    void printSkips(std::ostream &out) const;
+    static const char *tableType(size_t maxValue);
+
     class State;
     struct Transition
     {
-        Transition(const State *to_, size_t charIndex_) : to(to_), charIndex(charIndex_) {}
+        Transition(const State *to_, char c_) : to(to_), c(c_) {}
         const State *to;
-        size_t charIndex;
+        char c;
     };
     typedef std::unique_ptr<State> pState;
+    typedef std::vector<std::pair<unsigned char, unsigned char>> Ranges;
+    // a run of bytes that keeps a state in itself, tested as a handful of byte ranges; with 'stop' the ranges hold the
+    // bytes that end the run instead
+    struct Skip
+    {
+        Ranges ranges;
+        bool stop;
+    };
+    static constexpr size_t MAX_SKIP_RANGES = 4;
 
     std::vector<pState> states;
-    size_t numStates;
-    static vector<std::string> types;									/// figure out a better way of doing this
+    std::vector<Skip> skips;
+    std::vector<std::vector<size_t>> table;
+    std::vector<size_t> accepts;
+    std::vector<size_t> charClass;
+    Config config;
+    std::vector<std::string> types;
 };
-vector<std::string> CodeGen::types = vector<std::string>();
 class CodeGen::State
 {
 public:
-    State(size_t state_, size_t accepting_) : oldState(state_), accepting(accepting_) {}
+    State(size_t state_, size_t accepting_, std::string type_) : oldState(state_), accepting(accepting_), type(move(type_)) {}
     void AddTransitions(std::vector<Transition> &&trans);
     void InitStateNum(size_t num) { newState = num; }
+    void InitSkip(size_t num) { skip = num; }
+    const std::vector<char> *SelfLoop() const;
 
     bool Empty() const { return !transitions.size(); }
     void PrintTransitions(std::ostream &os) const;
-    void PrintDefinition(std::ostream &out) const;
-    std::string Call(bool useCont) const;
+    void PrintDefinition(std::ostream &out, bool label) const;
+    bool Targets(const State *state) const;
 private:
     struct TransGroup
     {
-        TransGroup(const State *to_, std::vector<size_t> &&charIndices_) : to(to_), charIndices(move(charIndices_)) {}
+        TransGroup(const State *to_, std::vector<char> &&chars_) : to(to_), chars(move(chars_)) {}
         const State *to;
-        std::vector<size_t> charIndices;
+        std::vector<char> chars;
     };
     size_t oldState;
     size_t newState;
     size_t accepting;
+    std::string type;
+    size_t skip = 0;
     std::vector<TransGroup> transitions;
 };
 
-class Parser {
-public:
-    Parser(std::istream &in_) : in(&in_) {}
-    bool ParseInput();
-    std::vector<NFA> GetNFAs() { return std::move(nfas); }
-    std::string GetError() { return std::move(error); }
-
-    Parser(Parser &&) = default;
-    Parser(const Parser &) = delete;
-    Parser &operator=(Parser &&) = default;
-    Parser &operator=(const Parser &) = delete;
-private:
-    Tree readLine();
-    std::string parseLine(const std::string &str);
+void ErrorExit(const std::string &message);
+bool ReadFile(const char *path, std::string &contents, bool binary = false);
+void WriteFile(const char *path, const std::string &contents, bool binary = false);
+bool WriteIfChanged(const char *path, const std::string &contents, bool binary = false);
 
-    std::istream *in;
-    std::vector<NFA> nfas;
-    std::string error;
-};
+// A cache file holds the key of the DFA it holds, the terminal names and the minimized DFA, which is all the emitter
+// needs. The key hashes the spec, GENERATOR_VERSION and the options that change how the DFA is built, so a cache is
+// only reused by the same generator building the same DFA; bump the version with any change to how a spec becomes a
+// DFA. CACHE_FORMAT is written after the magic and changes with the layout of the file itself.
+constexpr unsigned GENERATOR_VERSION = 2;
+constexpr unsigned CACHE_FORMAT = 1;
+std::uint64_t HashText(const std::string &text);
+std::uint64_t CacheKey(const std::string &spec, bool direct, bool simplify);
+std::unique_ptr<DFA> ReadCache(const char *path, std::uint64_t key, std::vector<std::string> &types);
+void WriteCache(const char *path, std::uint64_t key, const std::vector<std::string> &types, const DFA &dfa);
 
-void ErrorExit(const std::string &message);
+// Merges the rules, runs the subset construction and minimizes, timing each phase. 'simplify' applies to the NFA only,
+// since the position automaton has no epsilon transitions to begin with.
+template <typename Automaton> DFA BuildDFA(std::vector<Automaton> rules, ThreadPool &pool, Stats &stats,
+    bool simplify = false);
+NFA MergeRules(std::vector<NFA> rules, bool simplify);
+PositionAutomaton MergeRules(std::vector<PositionAutomaton> rules, bool simplify);
+// Builds the spec through both the NFA and the position automaton and exits with an error if the minimized DFAs differ.
+void CheckDirect(const std::string &spec, ThreadPool &pool);
+// Exits with an error unless minimizing the spec's DFA keeps its tokens and leaves no two equivalent states.
+void CheckMinimize(const std::string &spec, ThreadPool &pool);
+
+struct Options {
+    CodeGen::Config codeGen;
+    Stats::Format stats = Stats::Format::None;
+    const char *cache = nullptr;
+    const char *binary = nullptr;
+    unsigned threads = 0;
+    bool direct = false;
+    bool checkDirect = false;
+    bool checkMinimize = false;
+    bool simplify = false;
+    std::vector<const char *> files;
+};
+Options ParseOptions(int argc, char *argv[]);
 
 int main(int argc, char *argv[])
 {
-    if (argc != 6)
-        ErrorExit("Incorrect number of parameters!");
+    Options options = ParseOptions(argc, argv);
+    const auto &files = options.files;
+    Stats stats;
 
-    std::ifstream in;
-    if (!(in = std::ifstream(argv[1])))
-        ErrorExit("Failed to open file: "s + argv[1]);
+    ThreadPool pool(options.threads);
 
-    Parser parser(in);
-    if (!parser.ParseInput())
-        ErrorExit(parser.GetError());
-    in.close();
+    std::string spec;
+    if (!ReadFile(files[0], spec))
+        ErrorExit("Failed to open file: "s + files[0]);
+
+    if (options.checkDirect) {
+        CheckDirect(spec, pool);
+        stats.EndPhase("check");
+    }
+    if (options.checkMinimize) {
+        CheckMinimize(spec, pool);
+        stats.EndPhase("check");
+    }
+
+    // the other options only change what is emitted from the DFA
+    std::uint64_t key = CacheKey(spec, options.direct, options.simplify);
+    std::unique_ptr<DFA> minimal;
+    std::vector<std::string> types;
+    if (options.cache && (minimal = ReadCache(options.cache, key, types)))
+        stats.EndPhase("load");
+    else {
+        std::istringstream in(spec);
+        Parser parser(in, &pool, options.direct);
+        if (!parser.ParseInput())
+            ErrorExit(parser.GetError());
+        types = parser.GetTypes();
+        stats.EndPhase("parse");
+
+        if (options.direct)
+            minimal.reset(new DFA(BuildDFA(parser.GetPositions(), pool, stats)));
+        else
+            minimal.reset(new DFA(BuildDFA(parser.GetNFAs(), pool, stats, options.simplify)));
+
+        if (options.cache) {
+            WriteCache(options.cache, key, types, *minimal);
+            stats.EndPhase("store");
+        }
+    }
+
+    // CodeGen takes over the names, so the binary DFA is laid out first
+    std::string image;
+    if (options.binary)
+        image = minimal->SaveBinary(types);
 
-    std::vector<NFA> nfas = parser.GetNFAs();
-    CodeGen codeGen(DFA::Optimize(NFA::Merge(move(nfas))));
+    CodeGen codeGen(*minimal, move(types), options.codeGen);
     codeGen.PrintStates(std::cout);
 
-    std::ofstream out;
-    if (!(out = std::ofstream(argv[2])))
-        ErrorExit("Failed to open file: "s + argv[2]);
-    codeGen.PrintSymHeader(out);
+    // an output that would not change keeps its timestamp, so nothing that depends on it is rebuilt
+    size_t emitted = 0, written = 0;
+    auto write = [&](const char *file, const std::string &text, bool binary) {
+        if (WriteIfChanged(file, text, binary))
+            written++;
+        stats.Record("bytes:"s + file, text.size());
+        emitted += text.size();
+    };
+    auto emit = [&](const char *file, void (CodeGen::*print)(std::ostream &) const) {
+        std::ostringstream out;
+        (codeGen.*print)(out);
+        write(file, out.str(), false);
+    };
+    emit(files[1], &CodeGen::PrintSymHeader);
+    emit(files[2], &CodeGen::PrintTerminals);
+    emit(files[3], &CodeGen::PrintClass);
+    emit(files[4], &CodeGen::PrintDefinitions);
+    if (options.binary)
+        write(options.binary, image, true);
+    stats.EndPhase("emit");
 
-    if (!(out = std::ofstream(argv[3])))
-        ErrorExit("Failed to open file: "s + argv[3]);
-    codeGen.PrintTerminals(out);
+    stats.Record("minimized_states", minimal->Size());
+    stats.Record("alphabet_size", minimal->AlphabetSize());
+    stats.Record("emitted_bytes", emitted);
+    stats.Record("written_files", written);
+    stats.Print(std::cerr, options.stats);
+}
+
+template <typename Automaton> DFA BuildDFA(std::vector<Automaton> rules, ThreadPool &pool, Stats &stats,
+    bool simplify)
+{
+    Automaton automaton = MergeRules(move(rules), simplify);
+    stats.EndPhase("merge");
+    DFA dfa(automaton, &pool);
+    stats.EndPhase("subset");
+    DFA minimal = DFA::Optimize(dfa);
+    stats.EndPhase("minimize");
+    stats.Record("nfa_states", automaton.Size());
+    stats.Record("dfa_states", dfa.Size());
+    return minimal;
+}
+NFA MergeRules(std::vector<NFA> rules, bool simplify) {
+    return NFA::Merge(move(rules), simplify);
+}
+PositionAutomaton MergeRules(std::vector<PositionAutomaton> rules, bool) {
+    return PositionAutomaton::Merge(move(rules));
+}
+void CheckDirect(const std::string &spec, ThreadPool &pool) {
+    std::istringstream nfaIn(spec), directIn(spec);
+    Parser nfaParser(nfaIn, &pool), directParser(directIn, &pool, true);
+    if (!nfaParser.ParseInput())
+        ErrorExit(nfaParser.GetError());
+    if (!directParser.ParseInput())
+        ErrorExit(directParser.GetError());
 
-    if (!(out = std::ofstream(argv[4])))
-        ErrorExit("Failed to open file: "s + argv[4]);
-    codeGen.PrintClass(out);
+    Stats unused;
+    DFA expected = BuildDFA(nfaParser.GetNFAs(), pool, unused);
+    DFA actual = BuildDFA(directParser.GetPositions(), pool, unused);
+    if (!expected.Isomorphic(actual))
+        ErrorExit("--check-direct: the position automaton and the NFA lead to different DFAs");
+    std::cerr << "--check-direct: both constructions give the same " << expected.Size() << " state DFA" << std::endl;
+}
+void CheckMinimize(const std::string &spec, ThreadPool &pool) {
+    std::istringstream in(spec);
+    Parser parser(in, &pool);
+    if (!parser.ParseInput())
+        ErrorExit(parser.GetError());
 
-    if (!(out = std::ofstream(argv[5])))
-        ErrorExit("Failed to open file: "s + argv[5]);
-    codeGen.PrintDefinitions(out);
+    DFA dfa(NFA::Merge(parser.GetNFAs()), &pool);
+    DFA minimal = DFA::Optimize(dfa);
+    if (!dfa.Equivalent(minimal))
+        ErrorExit("--check-minimize: the minimized DFA recognizes different tokens");
+    if (!minimal.Minimal())
+        ErrorExit("--check-minimize: the minimized DFA still has equivalent states");
+    std::cerr << "--check-minimize: " << dfa.Size() << " states minimize to " << minimal.Size() << std::endl;
 }
 
 void ErrorExit(const std::string &message) {
     std::cerr << message << std::endl;
     exit(1);
 }
-
-bool Parser::ParseInput() {
-    try {
-        Tree tree;
-        for (size_t i = 1; tree = readLine(); i++)
-            nfas.push_back(tree.GenNfa(i));
-    }
-    catch (const RegexParserError &err) {
-        error = err.what();
+bool ReadFile(const char *path, std::string &contents, bool binary) {
+    std::ifstream in(path, binary ? std::ios::in | std::ios::binary : std::ios::in);
+    if (!in)
         return false;
+
+    std::ostringstream stream;
+    stream << in.rdbuf();
+    contents = stream.str();
+    return true;
+}
+void WriteFile(const char *path, const std::string &contents, bool binary) {
+    // The new contents go to a file beside the old one, which is then renamed over it. Readers never see a partial
+    // file, and a process that has the old --binary DFA mapped keeps its own intact copy until it unmaps it
+    std::string temporary = path + ".tmp"s;
+    {
+        std::ofstream out(temporary, binary ? std::ios::out | std::ios::binary : std::ios::out);
+        if (!(out << contents) || !out.flush())
+            ErrorExit("Failed to write file: "s + temporary);
     }
 
-    if (nfas.empty()) {
-        error = "Input file is empty!";
-        return false;
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        ErrorExit("Failed to write file: "s + path);
     }
+}
+bool WriteIfChanged(const char *path, const std::string &contents, bool binary) {
+    std::string existing;
+    if (ReadFile(path, existing, binary) && existing == contents)
+        return false;
 
+    WriteFile(path, contents, binary);
     return true;
 }
-Tree Parser::readLine() {
-    std::string line;
 
-    if (!std::getline(*in, line))
-        return {};
+std::uint64_t HashText(const std::string &text) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (char c : text)
+        hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+    return hash;
+}
+std::uint64_t CacheKey(const std::string &spec, bool direct, bool simplify) {
+    return HashText("LexerGen " + std::to_string(GENERATOR_VERSION) + (direct ? " --direct" : "") +
+        (simplify ? " --simplify" : "") + '\n' + spec);
+}
+std::unique_ptr<DFA> ReadCache(const char *path, std::uint64_t key, std::vector<std::string> &types) {
+    std::ifstream in(path);
+    std::string magic;
+    unsigned format;
+    std::uint64_t cachedKey;
+    size_t numTypes;
+    if (!(in >> magic >> format >> std::hex >> cachedKey >> std::dec >> numTypes) ||
+        magic != "LexerGen-cache" || format != CACHE_FORMAT || cachedKey != key)
+        return nullptr;
+
+    std::vector<std::string> names(numTypes);
+    for (std::string &name : names)
+        if (!(in >> name))
+            return nullptr;
+
+    std::unique_ptr<DFA> dfa = DFA::Load(in, names.size());
+    if (!dfa)
+        return nullptr;
+
+    types = move(names);
+    return dfa;
+}
+void WriteCache(const char *path, std::uint64_t key, const std::vector<std::string> &types, const DFA &dfa) {
+    std::ostringstream out;
+    out << "LexerGen-cache " << CACHE_FORMAT << ' ' << std::hex << key << std::dec << '\n' << types.size() << '\n';
+    for (const std::string &name : types)
+        out << name << '\n';
+    dfa.Save(out);
 
-    line = parseLine(line);
-    return Tree(line);
+    // a generator killed mid-write must not leave a truncated cache behind for the next run to trip over
+    WriteFile(path, out.str());
 }
-std::string Parser::parseLine(const std::string &str) {
-    std::stringstream stream(str);
 
-    if (stream.get() != ':')
-        ErrorExit("Lines must begin with :");
+Options ParseOptions(int argc, char *argv[]) {
+    Options options;
 
-    std::string word;
-    if (!(stream >> word))
-        ErrorExit("Expected Terminal name after : in " + str);
-    CodeGen::AddType(move(word));
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
 
-    if (!(stream >> word) || word != ">")
-        ErrorExit("Expected > after Terminal in " + str);
+        if (arg.compare(0, 2, "--") != 0)
+            options.files.push_back(argv[i]);
+        else if (arg == "--table")
+            options.codeGen.backend = CodeGen::Backend::Table;
+        else if (arg == "--tokens=owned")
+            options.codeGen.tokens = CodeGen::TokenMode::Owned;
+        else if (arg == "--tokens=view")
+            options.codeGen.tokens = CodeGen::TokenMode::View;
+        else if (arg == "--stream")
+            options.codeGen.stream = true;
+        else if (arg == "--parallel")
+            options.codeGen.parallel = true;
+        else if (arg == "--simd")
+            options.codeGen.simd = true;
+        else if (arg == "--direct")
+            options.direct = true;
+        else if (arg == "--check-direct")
+            options.checkDirect = true;
+        else if (arg == "--check-minimize")
+            options.checkMinimize = true;
+        else if (arg == "--simplify")
+            options.simplify = true;
+        else if (arg == "--stats")
+            options.stats = Stats::Format::Text;
+        else if (arg == "--stats=json")
+            options.stats = Stats::Format::Json;
+        else if (arg.compare(0, 8, "--cache=") == 0 && arg.size() > 8)
+            options.cache = argv[i] + 8;
+        else if (arg.compare(0, 9, "--binary=") == 0 && arg.size() > 9)
+            options.binary = argv[i] + 9;
+        else if (arg.compare(0, 10, "--threads=") == 0 && arg.size() > 10 &&
+            arg.find_first_not_of("0123456789", 10) == std::string::npos)
+            options.threads = (unsigned)std::stoul(arg.substr(10));
+        else
+            ErrorExit("Unknown option: " + arg);
+    }
 
-    std::string regEx;
-    if (!(stream >> regEx))
-        ErrorExit("Expected regular expression after Terminal name in " + str);
+    if (options.files.size() != 5)
+        ErrorExit("Incorrect number of parameters!\n"
+            "Usage: LexerGen [--table] [--tokens=owned|view] [--stream] [--parallel] [--simd] [--direct] [--check-direct] [--check-minimize] [--simplify] [--stats[=json]] [--cache=<file>] [--binary=<file>] [--threads=<n>] <spec> <Symbol.h> <Terminals.h> <Lexer.h> <Lexer.cpp>");
 
-    if (stream >> word)
-        ErrorExit("Unexpected text after regular expression in " + str);
+    // the streaming lexer resumes a token after refilling its buffer, which only the table driver can do, and the
+    // buffer is reused, so tokens cannot point into it
+    if (options.codeGen.stream && options.codeGen.backend != CodeGen::Backend::Table)
+        ErrorExit("--stream requires --table");
+    if (options.codeGen.stream && options.codeGen.tokens == CodeGen::TokenMode::View)
+        ErrorExit("--stream cannot be combined with --tokens=view");
+    if (options.codeGen.stream && options.codeGen.parallel)
+        ErrorExit("--stream cannot be combined with --parallel");
+    if (options.simplify && options.direct)
+        ErrorExit("--simplify cannot be combined with --direct");
+    // the table driver takes one lookup per byte whatever the state, so only the direct-coded scanner has loops to skip
+    if (options.codeGen.simd && options.codeGen.backend != CodeGen::Backend::Direct)
+        ErrorExit("--simd cannot be combined with --table");
 
-    return regEx;
+    return options;
 }
 
-DFA::DFA(const NFA &nfa)
+template <typename Automaton> DFA::DFA(const Automaton &automaton, ThreadPool *pool)
+    : charClass(automaton.CharClasses()), numClasses(automaton.AlphabetSize())
 {
-    vector<vector<bool>> states;
-    vector<bool> stateSet(nfa.Size(), false);
-    stateSet[0] = true;
-    states.push_back(move(nfa.Closure(stateSet)));
-    stateInfo.emplace_back();
-    stateInfo[0].accepting = nfa.Accepting(states[0]);
-    for (size_t stateIndex = 0; stateIndex < states.size(); stateIndex++)
+    // subsets are interned by value; 'states' points at the keys, which stay put when the table rehashes
+    std::unordered_map<Bitset, size_t> ids;
+    vector<const Bitset *> states;
+    auto intern = [&](Bitset &&subset)
+    {
+        auto [entry, inserted] = ids.try_emplace(move(subset), states.size());
+        if (inserted)
+        {
+            states.push_back(&entry->first);
+            stateInfo.emplace_back(numClasses);
+            stateInfo.back().accepting = automaton.Accepting(entry->first);
+        }
+        return entry->second + 1;
+    };
+
+    intern(automaton.Start());
+
+    // The queue is expanded a batch of states at a time. While a batch runs the table is only read, so the workers
+    // resolve the subsets it already holds on their own. The new ones are interned afterwards in state and class
+    // order, which numbers them exactly as expanding one state at a time would.
+    const size_t batchSize = 64 * (pool ? pool->Size() : 1);
+    vector<Bitset> fresh;
+    for (size_t begin = 0; begin < states.size();)
     {
-        for (size_t charIndex = 1; charIndex < NFA::AlphabetSize(); charIndex++)
+        size_t end = std::min(states.size(), begin + batchSize);
+        fresh.assign((end - begin) * numClasses, Bitset());
+
+        auto expand = [&](size_t i)
         {
-            stateSet = nfa.Move(states[stateIndex], charIndex);
-            if (isNonempty(stateSet))
+            size_t stateIndex = begin + i;
+            for (size_t charIndex = 1; charIndex < numClasses; charIndex++)
             {
-                for (size_t prevStateIndex = 0;; prevStateIndex++)
-                {
-                    if (prevStateIndex == states.size())
-                    {
-                        states.push_back(move(stateSet));
-                        stateInfo.emplace_back();
-                        stateInfo[prevStateIndex].accepting = nfa.Accepting(states[prevStateIndex]);
-                        stateInfo[stateIndex].transitions[charIndex] = prevStateIndex + 1;
-                        break;
-                    }
-                    else if (stateSet == states[prevStateIndex])
-                    {
-                        stateInfo[stateIndex].transitions[charIndex] = prevStateIndex + 1;
-                        break;
-                    }
-                }
+                Bitset next = automaton.Move(*states[stateIndex], charIndex);
+                size_t &to = stateInfo[stateIndex].transitions[charIndex];
+                if (!next.Any())
+                    to = 0;
+                else if (auto found = ids.find(next); found != ids.end())
+                    to = found->second + 1;
+                else
+                    fresh[i * numClasses + charIndex] = move(next);
             }
-            else
-                stateInfo[stateIndex].transitions[charIndex] = 0;
+        };
+        if (pool)
+            pool->ForEach(end - begin, expand);
+        else
+            for (size_t i = 0; i < end - begin; i++)
+                expand(i);
+
+        for (size_t i = 0; i < end - begin; i++)
+            for (size_t charIndex = 1; charIndex < numClasses; charIndex++)
+                if (Bitset &subset = fresh[i * numClasses + charIndex]; subset.Size())
+                    stateInfo[begin + i].transitions[charIndex] = intern(move(subset));
+        begin = end;
+    }
+}
+std::unique_ptr<DFA> DFA::Load(std::istream &in, size_t numTypes)
+{
+    std::unique_ptr<DFA> dfa(new DFA());
+    size_t size;
+    if (!(in >> dfa->numClasses >> size) || dfa->numClasses == 0)
+        return nullptr;
+
+    dfa->charClass.resize(256);
+    for (size_t &cIndex : dfa->charClass)
+        if (!(in >> cIndex) || cIndex >= dfa->numClasses)
+            return nullptr;
+
+    dfa->stateInfo.assign(size, StateInfo(dfa->numClasses));
+    for (StateInfo &state : dfa->stateInfo)
+    {
+        if (!(in >> state.accepting) || state.accepting > numTypes)
+            return nullptr;
+        for (size_t &to : state.transitions)
+            if (!(in >> to) || to > size)
+                return nullptr;
+    }
+    return dfa;
+}
+void DFA::Save(std::ostream &out) const
+{
+    out << numClasses << ' ' << stateInfo.size() << '\n';
+    for (size_t c = 0; c < charClass.size(); c++)
+        out << charClass[c] << ((c % 32 == 31) ? '\n' : ' ');
+    for (const StateInfo &state : stateInfo)
+    {
+        out << state.accepting;
+        for (size_t to : state.transitions)
+            out << ' ' << to;
+        out << '\n';
+    }
+}
+std::string DFA::SaveBinary(const std::vector<std::string> &types) const
+{
+    using namespace dfaFormat;
+
+    std::string names = "INVALID"s + '\0';
+    vector<std::uint32_t> nameStart{ 0 };
+    for (const std::string &type : types)
+    {
+        nameStart.push_back((std::uint32_t)names.size());
+        names += type + '\0';
+    }
+    nameStart.push_back((std::uint32_t)names.size());
+
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = ORDER_MARK;
+    header.states = (std::uint32_t)stateInfo.size();
+    header.classes = (std::uint32_t)numClasses;
+    header.types = (std::uint32_t)types.size();
+    header.width = Width((std::uint32_t)std::max(stateInfo.size(), types.size()));
+
+    // offsets are 32 bits wide, so the layout is worked out in 64 bits and checked before anything is written
+    std::uint64_t classOffset = Align(sizeof(Header));
+    std::uint64_t transOffset = Align(classOffset + 256 * sizeof(std::uint16_t));
+    std::uint64_t acceptOffset = Align(transOffset + (std::uint64_t)stateInfo.size() * numClasses * header.width);
+    std::uint64_t nameOffset = Align(acceptOffset + (std::uint64_t)stateInfo.size() * header.width);
+    std::uint64_t size = nameOffset + nameStart.size() * sizeof(std::uint32_t) + names.size();
+    if (size > UINT32_MAX)
+        ErrorExit("The DFA is too large for --binary");
+    header.classOffset = (std::uint32_t)classOffset;
+    header.transOffset = (std::uint32_t)transOffset;
+    header.acceptOffset = (std::uint32_t)acceptOffset;
+    header.nameOffset = (std::uint32_t)nameOffset;
+    header.size = (std::uint32_t)size;
+
+    std::string image(size, '\0');
+    auto put = [&](std::uint64_t offset, const void *data, size_t length) { std::memcpy(&image[offset], data, length); };
+    auto putWide = [&](std::uint64_t offset, size_t value)
+    {
+        std::uint8_t narrow = (std::uint8_t)value;
+        std::uint16_t half = (std::uint16_t)value;
+        std::uint32_t full = (std::uint32_t)value;
+        if (header.width == 1)
+            put(offset, &narrow, 1);
+        else if (header.width == 2)
+            put(offset, &half, 2);
+        else
+            put(offset, &full, 4);
+    };
+
+    put(0, &header, sizeof(header));
+    for (size_t c = 0; c < 256; c++)
+    {
+        std::uint16_t cIndex = (std::uint16_t)charClass[c];
+        put(classOffset + c * sizeof(cIndex), &cIndex, sizeof(cIndex));
+    }
+    for (size_t state = 0; state < stateInfo.size(); state++)
+    {
+        for (size_t cIndex = 0; cIndex < numClasses; cIndex++)
+            putWide(transOffset + (state * numClasses + cIndex) * header.width, stateInfo[state].transitions[cIndex]);
+        putWide(acceptOffset + state * header.width, stateInfo[state].accepting);
+    }
+    put(nameOffset, nameStart.data(), nameStart.size() * sizeof(std::uint32_t));
+    put(nameOffset + nameStart.size() * sizeof(std::uint32_t), names.data(), names.size());
+
+    return image;
+}
+bool DFA::Isomorphic(const DFA &other) const
+{
+    if (stateInfo.size() != other.stateInfo.size())
+        return false;
+
+    // partner and back are 1 based like the transitions, with 0 for not yet paired
+    vector<size_t> partner(stateInfo.size() + 1, 0), back(stateInfo.size() + 1, 0), queue{ 1 };
+    partner[1] = back[1] = 1;
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        const StateInfo &lhs = stateInfo[queue[i] - 1], &rhs = other.stateInfo[partner[queue[i]] - 1];
+        if (lhs.accepting != rhs.accepting)
+            return false;
+
+        for (size_t c = 0; c < 256; c++)
+        {
+            size_t to = lhs.transitions[charClass[c]], otherTo = rhs.transitions[other.charClass[c]];
+            if (!to || !otherTo)
+            {
+                if (to != otherTo)
+                    return false;
+            }
+            else if (!partner[to] && !back[otherTo])
+            {
+                partner[to] = otherTo;
+                back[otherTo] = to;
+                queue.push_back(to);
+            }
+            else if (partner[to] != otherTo)
+                return false;
         }
     }
+    return true;
 }
-DFA DFA::Optimize(const DFA &dfa)
+bool DFA::Equivalent(const DFA &other) const
 {
-    struct transition
+    // pairs of states are 1 based like the transitions, with 0 for the dead state on either side
+    std::set<std::pair<size_t, size_t>> seen{ { 1, 1 } };
+    vector<std::pair<size_t, size_t>> queue{ { 1, 1 } };
+    for (size_t i = 0; i < queue.size(); i++)
     {
-        size_t fromOld, fromNew, to;
-        bool marked;
+        auto [lhs, rhs] = queue[i];
+        size_t lhsAccepting = lhs ? stateInfo[lhs - 1].accepting : 0;
+        size_t rhsAccepting = rhs ? other.stateInfo[rhs - 1].accepting : 0;
+        if (lhsAccepting != rhsAccepting)
+            return false;
+
+        for (size_t c = 0; c < 256; c++)
+        {
+            size_t to = lhs ? stateInfo[lhs - 1].transitions[charClass[c]] : 0;
+            size_t otherTo = rhs ? other.stateInfo[rhs - 1].transitions[other.charClass[c]] : 0;
+            if ((to || otherTo) && seen.emplace(to, otherTo).second)
+                queue.emplace_back(to, otherTo);
+        }
+    }
+    return true;
+}
+bool DFA::Minimal() const
+{
+    // block of every state, 1 based like the transitions with the dead state as 0, refined by the blocks of its
+    // targets until the number of blocks stops growing
+    const size_t n = stateInfo.size() + 1;
+    vector<size_t> block(n, 0);
+    size_t blocks = 0;
+    for (;;)
+    {
+        std::map<vector<size_t>, size_t> signatures;
+        vector<size_t> next(n);
+        for (size_t state = 0; state < n; state++)
+        {
+            vector<size_t> signature{ block[state], state ? stateInfo[state - 1].accepting : 0 };
+            for (size_t charIndex = 1; charIndex < numClasses; charIndex++)
+                signature.push_back(block[state ? stateInfo[state - 1].transitions[charIndex] : 0]);
+            next[state] = signatures.try_emplace(move(signature), signatures.size()).first->second;
+        }
+
+        block.swap(next);
+        if (signatures.size() == blocks)
+            return blocks == n;
+        blocks = signatures.size();
+    }
+}
+DFA DFA::Optimize(const DFA &dfa)
+{
+    // Hopcroft's partition refinement. State n is an explicit dead state so that every state has a transition on
+    // every character; blocks are kept as contiguous ranges of 'elements' with their marked states at the front.
+    const size_t n = dfa.stateInfo.size() + 1, numChars = dfa.numClasses;
+    auto target = [&](size_t state, size_t charIndex) {
+        if (state == n - 1 || !dfa.stateInfo[state].transitions[charIndex])
+            return n - 1;
+        return dfa.stateInfo[state].transitions[charIndex] - 1;
     };
-    vector<size_t> states;
-    states.reserve(dfa.stateInfo.size());
-    size_t numStates = 1;
-    bool nonAccepting = false;
-    for (auto info : dfa.stateInfo)
+
+    vector<size_t> inverseStart((numChars - 1) * n + 1, 0), inverse((numChars - 1) * n);
+    for (size_t charIndex = 1; charIndex < numChars; charIndex++)
+        for (size_t state = 0; state < n; state++)
+            inverseStart[(charIndex - 1) * n + target(state, charIndex) + 1]++;
+    for (size_t i = 1; i < inverseStart.size(); i++)
+        inverseStart[i] += inverseStart[i - 1];
+    vector<size_t> fill(inverseStart.begin(), inverseStart.end() - 1);
+    for (size_t charIndex = 1; charIndex < numChars; charIndex++)
+        for (size_t state = 0; state < n; state++)
+            inverse[fill[(charIndex - 1) * n + target(state, charIndex)]++] = state;
+
+    auto acceptingType = [&](size_t state) { return (state == n - 1) ? 0 : dfa.stateInfo[state].accepting; };
+    vector<size_t> elements(n), location(n), blockOf(n);
+    for (size_t state = 0; state < n; state++)
+        elements[state] = state;
+    std::stable_sort(elements.begin(), elements.end(), [&](size_t lhs, size_t rhs) { return acceptingType(lhs) < acceptingType(rhs); });
+
+    vector<size_t> first, past, marked;
+    for (size_t i = 0; i < n; i++)
     {
-        if (!info.accepting)
-            nonAccepting = true;
-        if (info.accepting > numStates)
-            numStates = info.accepting;
-    }
-    if (nonAccepting)
-        numStates++;
-    size_t offset = numStates - dfa.stateInfo[0].accepting;
-    for (auto info : dfa.stateInfo)
-        states.push_back((info.accepting + offset) % numStates + 1);
-    bool consistent = false;
-    while (!consistent)
+        if (i == 0 || acceptingType(elements[i]) != acceptingType(elements[i - 1]))
+        {
+            first.push_back(i);
+            past.push_back(i);
+            marked.push_back(0);
+        }
+        past.back()++;
+        location[elements[i]] = i;
+        blockOf[elements[i]] = first.size() - 1;
+    }
+
+    vector<std::pair<size_t, size_t>> worklist;
+    for (size_t block = 0; block < first.size(); block++)
+        for (size_t charIndex = 1; charIndex < numChars; charIndex++)
+            worklist.emplace_back(block, charIndex);
+
+    vector<size_t> touched, splitterStates;
+    while (!worklist.empty())
     {
-        consistent = true;
-        for (size_t charIndex = 1; charIndex < NFA::AlphabetSize(); charIndex++)
+        auto [splitter, charIndex] = worklist.back();
+        worklist.pop_back();
+
+        // marking a predecessor that lies in the splitter itself reorders the splitter's range, so its states are
+        // copied out before any of them are marked
+        splitterStates.assign(elements.begin() + first[splitter], elements.begin() + past[splitter]);
+        for (size_t to : splitterStates)
         {
-            vector<transition> transitions;
-            transitions.reserve(states.size());
-            vector<size_t> currentTransVals(numStates);
-            for (size_t dfaState = states.size(); dfaState-- > 0;)
+            size_t base = (charIndex - 1) * n + to;
+            for (size_t j = inverseStart[base]; j < inverseStart[base + 1]; j++)
             {
-                size_t trans = (dfa.stateInfo[dfaState].transitions[charIndex] == 0) ?
-                    0 : states[dfa.stateInfo[dfaState].transitions[charIndex] - 1];
-                currentTransVals[states[dfaState] - 1] = trans;
-                transitions.push_back({ dfaState, states[dfaState], trans });
+                size_t from = inverse[j], block = blockOf[from];
+                size_t swapIndex = first[block] + marked[block];
+                if (location[from] < swapIndex)
+                    continue;
+
+                std::swap(elements[location[from]], elements[swapIndex]);
+                location[elements[location[from]]] = location[from];
+                location[from] = swapIndex;
+                if (!marked[block]++)
+                    touched.push_back(block);
             }
-            for (size_t i = transitions.size(); i-- > 0;)
+        }
+
+        for (size_t block : touched)
+        {
+            size_t split = first[block] + marked[block];
+            marked[block] = 0;
+            if (split == past[block])
+                continue;
+
+            // the smaller half becomes the new block; adding it alone to the worklist is sufficient
+            size_t newBlock = first.size();
+            if (split - first[block] <= past[block] - split)
             {
-                if (transitions[i].marked == false)
-                {
-                    if (transitions[i].to != currentTransVals[transitions[i].fromNew - 1])
-                    {
-                        consistent = false;
-                        states[transitions[i].fromOld] = ++numStates;
-                        currentTransVals[transitions[i].fromNew - 1] = transitions[i].to; //experimental: num_states
-                    }
-                    for (size_t j = i; j-- > 0;)
-                    {
-                        if ((transitions[j].marked == false) && (transitions[j].fromNew == transitions[i].fromNew) &&
-                            (transitions[j].to == currentTransVals[transitions[j].fromNew - 1]))
-                        {
-                            transitions[j].marked = true;
-                            states[transitions[j].fromOld] = states[transitions[i].fromOld];
-                        }
-                    }
-                }
+                first.push_back(first[block]);
+                past.push_back(split);
+                first[block] = split;
             }
+            else
+            {
+                first.push_back(split);
+                past.push_back(past[block]);
+                past[block] = split;
+            }
+            marked.push_back(0);
+
+            for (size_t i = first[newBlock]; i < past[newBlock]; i++)
+                blockOf[elements[i]] = newBlock;
+            for (size_t c = 1; c < numChars; c++)
+                worklist.emplace_back(newBlock, c);
         }
+        touched.clear();
     }
 
+    // number the surviving blocks in order of their first original state, keeping the start state first and
+    // dropping the block that contains the dead state
+    const size_t dead = blockOf[n - 1];
+    vector<size_t> newNum(first.size(), 0);
+    size_t numStates = 0;
+    for (size_t state = 0; state < n - 1; state++)
+        if (blockOf[state] != dead && !newNum[blockOf[state]])
+            newNum[blockOf[state]] = ++numStates;
+
     DFA opt;
-    opt.stateInfo = vector<StateInfo>(numStates);
-    for (size_t i = 0; i < states.size(); i++)
+    opt.stateInfo = vector<StateInfo>(numStates, StateInfo(numChars));
+    opt.charClass = dfa.charClass;
+    opt.numClasses = numChars;
+    for (size_t state = 0; state < n - 1; state++)
     {
-        opt.stateInfo[states[i] - 1].accepting = dfa.stateInfo[i].accepting;
-        for (size_t j = 1; j < NFA::AlphabetSize(); j++)
-            opt.stateInfo[states[i] - 1].transitions[j] = (dfa.stateInfo[i].transitions[j] == 0) ? 0 : states[dfa.stateInfo[i].transitions[j] - 1];
+        if (blockOf[state] == dead)
+            continue;
+
+        StateInfo &info = opt.stateInfo[newNum[blockOf[state]] - 1];
+        info.accepting = dfa.stateInfo[state].accepting;
+        for (size_t charIndex = 1; charIndex < numChars; charIndex++)
+            info.transitions[charIndex] = newNum[blockOf[target(state, charIndex)]];
     }
     return opt;
 }
-bool DFA::isNonempty(const vector<bool> &subset)				// should be static
-{
-    for (auto element : subset)
-        if (element == true)
-            return true;
-    return false;
-}
 
-CodeGen::CodeGen(const DFA &dfa)
+CodeGen::CodeGen(const DFA &dfa, std::vector<std::string> types_, const Config &config_) :
+    charClass(dfa.CharClasses()), config(config_), types(move(types_))
 {
-    std::vector<std::vector<size_t>> transitions;
-    transitions.reserve(dfa.Size());
+    table.reserve(dfa.Size());
+    accepts.reserve(dfa.Size());
     for (size_t state = 0; state < dfa.Size(); state++)
     {
         auto [accepting, trans] = dfa[state];
-        transitions.push_back(trans);
-        states.emplace_back(new State(state + 1, accepting));
+        table.push_back(trans);
+        accepts.push_back(accepting);
+        states.emplace_back(new State(state + 1, accepting, accepting ? types[accepting - 1] : ""));
     }
-    for (size_t state = 0; state < transitions.size(); state++)
+    for (size_t state = 0; state < table.size(); state++)
     {
         std::vector<Transition> transList;
-        transList.reserve(transitions.size());
-        for (size_t charIndex = 1; charIndex < transitions[0].size(); charIndex++)
-            if (transitions[state][charIndex])
-                transList.emplace_back(states[transitions[state][charIndex] - 1].get(), charIndex);
+        transList.reserve(charClass.size());
+        for (size_t c = 0; c < charClass.size(); c++)
+            if (size_t to = table[state][charClass[c]])
+                transList.emplace_back(states[to - 1].get(), (char)c);
         states[state]->AddTransitions(move(transList));
     }
     states[0]->InitStateNum(1);
-    numStates = 1;
+    size_t num = 1;
     for (size_t state = 1; state < states.size(); state++)
         if (!states[state]->Empty())
-            states[state]->InitStateNum(++numStates);
-}
-void CodeGen::AddType(std::string &&name)
-{
-    types.push_back(move(name));
+            states[state]->InitStateNum(++num);
+
+    if (!config.simd)
+        return;
+
+    for (const pState &state : states)
+    {
+        const std::vector<char> *loop = state->SelfLoop();
+        if (!loop)
+            continue;
+
+        // the loop bytes and the bytes ending the run are each described by their ranges, and whichever takes fewer
+        // compares per block wins
+        Ranges in, out;
+        for (size_t c = 0, i = 0; c < 256; c++)
+        {
+            bool looping = i < loop->size() && (unsigned char)(*loop)[i] == c;
+            i += looping;
+            Ranges &ranges = looping ? in : out;
+            if (!ranges.empty() && ranges.back().second == c - 1)
+                ranges.back().second = (unsigned char)c;
+            else
+                ranges.emplace_back((unsigned char)c, (unsigned char)c);
+        }
+        Skip skip = (out.size() < in.size()) ? Skip{ move(out), true } : Skip{ move(in), false };
+        if (skip.ranges.size() > MAX_SKIP_RANGES)
+            continue;
+
+        auto found = std::find_if(skips.begin(), skips.end(), [&](const Skip &other) {
+            return other.stop == skip.stop && other.ranges == skip.ranges;
+        });
+        if (found == skips.end())
+            found = skips.insert(skips.end(), move(skip));
+        state->InitSkip(found - skips.begin() + 1);
+    }
 }
 void CodeGen::PrintStates(std::ostream &os) const
 {
@@ -369,42 +934,86 @@ void CodeGen::PrintStates(std::ostream &os) const
 }
 void CodeGen::PrintClass(std::ostream &out) const
 {
+    if (config.stream) {
+        printStreamClass(out);
+        return;
+    }
+
+    bool view = config.tokens == TokenMode::View;
+
     out <<
         "#ifndef LEXER_H__\n"
         "#define LEXER_H__\n\n"
 
         "#include <memory>\n"
-        "#include <string>\n"
+        "#include <string>\n";
+    if (view)
+        out << "#include <string_view>\n";
+    out <<
         "#include <vector>\n"
         "#include \"Terminals.h\"\n\n"
 
         "class Lexer {\n"
-        "public:\n"
+        "public:\n";
+    if (view) {
+        printTypeEnum(out);
+        out <<
+            "    struct Token {\n"
+            "        Type Kind;\n"
+            "        size_t Offset;\n"
+            "        size_t Length;\n"
+            "    };\n";
+    }
+    out <<
         "    struct Error {\n"
         "        std::string Token;\n"
         "    };\n\n"
 
-        "    Lexer(const std::string &in) : in(&in) {}\n"
-        "    bool CreateTokens();\n"
-        "    std::vector<pTerminal> GetTokens() { return std::move(tokens); };\n"
+        "    Lexer(const std::string &in) : in(&in), next(in.begin()) {}\n"
+        "    bool CreateTokens();\n";
+    if (config.parallel)
+        out << "    // the same tokens as CreateTokens, lexed on 'threads' threads or on every hardware thread if it is 0\n"
+            "    bool CreateTokensParallel(unsigned threads = 0);\n";
+    if (view)
+        out << "    // returns false on an error; at the end of the input 'token' is INVALID\n"
+            "    bool NextToken(Token &token);\n";
+    else
+        out << "    // returns false on an error; at the end of the input 'token' is null\n"
+            "    bool NextToken(pTerminal &token);\n";
+    if (view)
+        out <<
+            "    std::vector<Token> GetTokens() { return std::move(tokens); };\n"
+            "    std::string_view Text(const Token &token) const { return { in->data() + token.Offset, token.Length }; }\n"
+            "    static const char *Name(Type type);\n";
+    else
+        out << "    std::vector<pTerminal> GetTokens() { return std::move(tokens); };\n";
+    out <<
         "    Error GetErrorReport() { return std::move(err); }\n\n"
 
         "    Lexer(Lexer &&) = default;\n"
         "    Lexer &operator=(Lexer &&) = default;\n"
         "private:\n"
-        "    using Iterator = std::string::const_iterator;\n"
-        "    enum Type { INVALID";
+        "    using Iterator = std::string::const_iterator;\n";
+    if (!view)
+        printTypeEnum(out);
+    if (config.parallel)
+        out << "    struct Span {\n"
+            "        Type type;\n"
+            "        size_t begin, end;\n"
+            "    };\n";
+    out << '\n';
 
-    for (const auto &type : types)
-        out << ", " << ToUpper(type);
-    out << " };\n\n";
+    if (!view)
+        out << "    static pTerminal makeToken(Type type, std::string value);\n";
 
-    for (size_t i = 1; i <= numStates; i++)
-        out << "    static Type State_" << i << "(Iterator &it, Iterator end);\n";
+    // every backend agrees that an empty match is no token, so the lexer reports an error rather than stalling
+    out << "    // moves 'it' past the longest token of at least one byte and returns its type, or INVALID if there is none\n"
+        "    static Type Scan(Iterator &it, Iterator end);\n";
 
     out <<
       "\n    const std::string *in;\n"
-        "    std::vector<pTerminal> tokens;\n"
+        "    Iterator next;\n"
+        "    std::vector<" << (view ? "Token" : "pTerminal") << "> tokens;\n"
         "    Error err;\n"
         "};\n\n"
 
@@ -451,28 +1060,84 @@ void CodeGen::PrintTerminals(std::ostream &out) const
 }
 void CodeGen::PrintDefinitions(std::ostream &out) const
 {
-    out << "#include \"Lexer.h\"\n\n"
-        "bool Lexer::CreateTokens() {\n"
-        "    Iterator begin = in->begin(), it = begin, end = in->end();\n\n"
-        "    while (it != end) {\n"
-        "        Type type = State_1(it, end);\n\n"
-        "        switch (type) {\n";
-    for (const auto &type : types)
-        out << "        case " << ToUpper(type) << ":\n"
-        "            tokens.emplace_back(new " << type << "(std::string(begin, it)));\n"
-        "            break;\n";
-    out << "        default:\n"
-        "            err = { std::string(begin, end) };\n"
+    if (config.stream) {
+        printStreamDefinitions(out);
+        return;
+    }
+
+    bool table = config.backend == Backend::Table;
+
+    out << "#include \"Lexer.h\"\n\n";
+    if (config.parallel)
+        out << "#include <algorithm>\n";
+    if (table)
+        out << "#include <cstdint>\n";
+    if (config.parallel)
+        out << "#include <thread>\n";
+    if (table || config.parallel)
+        out << '\n';
+
+    bool view = config.tokens == TokenMode::View;
+
+    out << "bool Lexer::CreateTokens() {\n"
+        "    for (" << (view ? "Token" : "pTerminal") << " token;;) {\n"
+        "        if (!NextToken(token))\n"
         "            return false;\n"
-        "        }\n\n"
-        "        begin = it;\n"
-        "    }\n\n"
+        "        if (" << (view ? "token.Kind == INVALID" : "!token") << ")\n"
+        "            return true;\n\n"
+        "        tokens.push_back(std::move(token));\n"
+        "    }\n"
+        "}\n";
+
+    out << "bool Lexer::NextToken(" << (view ? "Token" : "pTerminal") << " &token) {\n"
+        "    Iterator begin = next, it = next, end = in->end();\n";
+    if (view)
+        out << "    token = { INVALID, size_t(begin - in->begin()), 0 };\n";
+    else
+        out << "    token.reset();\n";
+    out << "    if (it == end)\n"
+        "        return true;\n\n"
+        "    Type type = Scan(it, end);\n";
+    if (view)
+        out << "    if (type == INVALID) {\n"
+            "        err = { std::string(begin, end) };\n"
+            "        return false;\n"
+            "    }\n"
+            "    token = { type, size_t(begin - in->begin()), size_t(it - begin) };\n";
+    else
+        out << "    token = makeToken(type, std::string(begin, it));\n"
+            "    if (!token) {\n"
+            "        err = { std::string(begin, end) };\n"
+            "        return false;\n"
+            "    }\n";
+    out << "\n    next = it;\n"
         "    return true;\n"
         "}\n";
-    states[0]->PrintDefinition(out);
-    for (size_t i = 1; i < states.size(); i++)
-        if (!states[i]->Empty())
-            states[i]->PrintDefinition(out);
+
+    if (config.parallel)
+        printParallel(out);
+    if (!view)
+        printMakeToken(out);
+
+    if (view) {
+        out << "\nconst char *Lexer::Name(Type type) {\n"
+            "    static const char *const names[] = { \"INVALID\"";
+        for (const auto &type : types)
+            out << ", \"" << type << '"';
+        out << " };\n"
+            "    return names[type];\n"
+            "}\n";
+    }
+
+    if (table) {
+        printTables(out);
+        printScan(out);
+        return;
+    }
+
+    if (!skips.empty())
+        printSkips(out);
+    printDirectScan(out);
 }
 void CodeGen::PrintSymHeader(std::ostream &out) const {
     out <<
@@ -501,6 +1166,416 @@ void CodeGen::PrintSymHeader(std::ostream &out) const {
 
         "#endif\n";
 }
+void CodeGen::printTypeEnum(std::ostream &out) const {
+    out << "    enum Type { INVALID";
+    for (const auto &type : types)
+        out << ", " << ToUpper(type);
+    out << " };\n";
+}
+void CodeGen::printMakeToken(std::ostream &out) const {
+    out << "\npTerminal Lexer::makeToken(Type type, std::string value) {\n"
+        "    switch (type) {\n";
+    // a rule named in upper case, like A, has an enumerator of the same name that hides its class inside Lexer
+    for (const auto &type : types)
+        out << "    case " << ToUpper(type) << ":\n"
+        "        return pTerminal(new ::" << type << "(std::move(value)));\n";
+    out << "    default:\n"
+        "        return nullptr;\n"
+        "    }\n"
+        "}\n";
+}
+void CodeGen::printParallel(std::ostream &out) const {
+    out <<
+        "\n"
+        "// Lexes the input on 'threads' threads and produces exactly the tokens CreateTokens would. Each chunk is lexed\n"
+        "// speculatively as if a token started at its first byte; stitching then lexes sequentially from the end of the\n"
+        "// true token stream until it reaches the start of a speculative token, after which both streams agree.\n"
+        "bool Lexer::CreateTokensParallel(unsigned threads) {\n"
+        "    const size_t size = in->size(), minChunk = 1 << 16, none = std::string::npos;\n"
+        "    if (!threads)\n"
+        "        threads = std::max(1u, std::thread::hardware_concurrency());\n"
+        "\n"
+        "    size_t chunks = std::min<size_t>(threads, size / minChunk);\n"
+        "    if (chunks < 2)\n"
+        "        return CreateTokens();\n"
+        "\n"
+        "    auto bound = [&](size_t chunk) { return size * chunk / chunks; };\n"
+        "    auto parallel = [&](auto &&work) {\n"
+        "        std::vector<std::thread> workers;\n"
+        "        for (size_t chunk = 1; chunk < chunks; chunk++)\n"
+        "            workers.emplace_back(work, chunk);\n"
+        "        work(0);\n"
+        "        for (auto &worker : workers)\n"
+        "            worker.join();\n"
+        "    };\n"
+        "\n"
+        "    // each chunk stops at the first token that starts in the next one, or where it ran into an invalid token\n"
+        "    std::vector<std::vector<Span>> spans(chunks);\n"
+        "    std::vector<size_t> failed(chunks, none);\n"
+        "    parallel([&](size_t chunk) {\n"
+        "        Iterator first = in->begin(), it = first + bound(chunk), end = in->end();\n"
+        "\n"
+        "        while (it != end && size_t(it - first) < bound(chunk + 1)) {\n"
+        "            Iterator begin = it;\n"
+        "            Type type = Scan(it, end);\n"
+        "            if (type == INVALID) {\n"
+        "                failed[chunk] = begin - first;\n"
+        "                break;\n"
+        "            }\n"
+        "            spans[chunk].push_back({ type, size_t(begin - first), size_t(it - first) });\n"
+        "        }\n"
+        "    });\n"
+        "\n"
+        "    // as in CreateTokens, an invalid token ends the stream but keeps every token before it\n"
+        "    std::vector<Span> result;\n"
+        "    size_t pos = 0;\n"
+        "    bool ok = true;\n"
+        "    for (size_t chunk = 0; chunk < chunks && pos != size && ok; chunk++) {\n"
+        "        const auto &guess = spans[chunk];\n"
+        "\n"
+        "        for (size_t i = 0; pos < bound(chunk + 1) && pos != size;) {\n"
+        "            while (i < guess.size() && guess[i].begin < pos)\n"
+        "                i++;\n"
+        "\n"
+        "            if (i < guess.size() && guess[i].begin == pos) {\n"
+        "                result.insert(result.end(), guess.begin() + i, guess.end());\n"
+        "                pos = guess.back().end;\n"
+        "                if (failed[chunk] != none)\n"
+        "                    pos = failed[chunk];\n"
+        "                break;\n"
+        "            }\n"
+        "\n"
+        "            Iterator it = in->begin() + pos;\n"
+        "            Type type = INVALID;\n"
+        "            if (failed[chunk] != pos)\n"
+        "                type = Scan(it, in->end());\n"
+        "            if (type == INVALID) {\n"
+        "                failed[chunk] = pos;\n"
+        "                break;\n"
+        "            }\n"
+        "\n"
+        "            result.push_back({ type, pos, size_t(it - in->begin()) });\n"
+        "            pos = result.back().end;\n"
+        "        }\n"
+        "\n"
+        "        ok = failed[chunk] != pos;\n"
+        "    }\n"
+        "\n";
+
+    if (config.tokens == TokenMode::View)
+        out <<
+        "    tokens.reserve(tokens.size() + result.size());\n"
+        "    for (const auto &span : result)\n"
+        "        tokens.push_back({ span.type, span.begin, span.end - span.begin });\n";
+    else
+        out <<
+        "    size_t offset = tokens.size();\n"
+        "    tokens.resize(offset + result.size());\n"
+        "    parallel([&](size_t chunk) {\n"
+        "        for (size_t i = result.size() * chunk / chunks; i < result.size() * (chunk + 1) / chunks; i++)\n"
+        "            tokens[offset + i] = makeToken(result[i].type, std::string(in->begin() + result[i].begin, in->begin() + result[i].end));\n"
+        "    });\n";
+
+    out <<
+        "\n"
+        "    next = in->begin() + pos;\n"
+        "    if (!ok)\n"
+        "        err = { std::string(next, in->end()) };\n"
+        "    return ok;\n"
+        "}\n";
+}
+void CodeGen::printStreamClass(std::ostream &out) const {
+    out <<
+        "#ifndef LEXER_H__\n"
+        "#define LEXER_H__\n\n"
+
+        "#include <functional>\n"
+        "#include <istream>\n"
+        "#include <memory>\n"
+        "#include <string>\n"
+        "#include <vector>\n"
+        "#include \"Terminals.h\"\n\n"
+
+        "class Lexer {\n"
+        "public:\n"
+        "    struct Error {\n"
+        "        std::string Token;\n"
+        "    };\n"
+        "    // fills up to 'size' bytes of 'buffer' and returns how many it wrote, 0 at the end of the input\n"
+        "    using Reader = std::function<size_t(char *buffer, size_t size)>;\n"
+        "    using Sink = std::function<void(pTerminal token)>;\n\n"
+
+        "    Lexer(Reader read, size_t bufferSize = 1 << 16);\n"
+        "    Lexer(std::istream &in, size_t bufferSize = 1 << 16);\n"
+        "#if defined(__unix__) || defined(__APPLE__)\n"
+        "    Lexer(int fd, size_t bufferSize = 1 << 16);\n"
+        "#endif\n"
+        "    bool CreateTokens();\n"
+        "    bool CreateTokens(const Sink &sink);\n"
+        "    // returns false on an error; at the end of the input 'token' is null\n"
+        "    bool NextToken(pTerminal &token);\n"
+        "    std::vector<pTerminal> GetTokens() { return std::move(tokens); };\n"
+        "    Error GetErrorReport() { return std::move(err); }\n\n"
+
+        "    Lexer(Lexer &&) = default;\n"
+        "    Lexer &operator=(Lexer &&) = default;\n"
+        "private:\n";
+    printTypeEnum(out);
+    out << "\n"
+        "    static pTerminal makeToken(Type type, std::string value);\n"
+        "    Type scan(size_t &length);\n"
+        "    bool refill();\n\n"
+
+        "    Reader read;\n"
+        "    std::vector<char> buffer;\n"
+        "    size_t start = 0, fill = 0;\n"
+        "    bool eof = false;\n"
+        "    std::vector<pTerminal> tokens;\n"
+        "    Error err;\n"
+        "};\n\n"
+
+        "#endif\n";
+}
+void CodeGen::printStreamDefinitions(std::ostream &out) const {
+    out << "#include \"Lexer.h\"\n\n"
+        "#include <cstdint>\n"
+        "#include <cstring>\n"
+        "#if defined(__unix__) || defined(__APPLE__)\n"
+        "#include <unistd.h>\n"
+        "#endif\n\n"
+
+        "Lexer::Lexer(Reader read, size_t bufferSize) : read(std::move(read)), buffer(bufferSize ? bufferSize : 1) {}\n"
+        "Lexer::Lexer(std::istream &in, size_t bufferSize) :\n"
+        "    Lexer([&in](char *buffer, size_t size) { in.read(buffer, size); return (size_t)in.gcount(); }, bufferSize) {}\n"
+        "#if defined(__unix__) || defined(__APPLE__)\n"
+        "Lexer::Lexer(int fd, size_t bufferSize) :\n"
+        "    Lexer([fd](char *buffer, size_t size) { ssize_t count = ::read(fd, buffer, size); return count > 0 ? (size_t)count : 0; }, bufferSize) {}\n"
+        "#endif\n\n"
+
+        "bool Lexer::CreateTokens() {\n"
+        "    return CreateTokens([this](pTerminal token) { tokens.push_back(std::move(token)); });\n"
+        "}\n"
+        "bool Lexer::CreateTokens(const Sink &sink) {\n"
+        "    for (pTerminal token;;) {\n"
+        "        if (!NextToken(token))\n"
+        "            return false;\n"
+        "        if (!token)\n"
+        "            return true;\n\n"
+        "        sink(std::move(token));\n"
+        "    }\n"
+        "}\n"
+        "bool Lexer::NextToken(pTerminal &token) {\n"
+        "    token.reset();\n"
+        "    if (start == fill && !refill())\n"
+        "        return true;\n\n"
+        "    size_t length;\n"
+        "    Type type = scan(length);\n"
+        "    const char *text = buffer.data() + start;\n"
+        "    token = makeToken(type, std::string(text, length));\n"
+        "    if (!token) {\n"
+        "        err = { std::string(text, fill - start) };\n"
+        "        return false;\n"
+        "    }\n\n"
+        "    start += length;\n"
+        "    return true;\n"
+        "}\n";
+    printMakeToken(out);
+
+    printTables(out);
+
+    out << "\n// scans the token at 'start', refilling the buffer whenever the token runs past the data read so far\n"
+        "Lexer::Type Lexer::scan(size_t &length) {\n"
+        "    Type type = INVALID;\n"
+        "    size_t pos = 0;\n"
+        "    length = 0;\n\n"
+        "    for (size_t state = 1;;) {\n"
+        "        if (start + pos == fill && !refill())\n"
+        "            break;\n\n"
+        "        state = transitions[state][charClass[(unsigned char)buffer[start + pos++]]];\n"
+        "        if (!state)\n"
+        "            break;\n\n"
+        "        if (accepting[state]) {\n"
+        "            type = (Type)accepting[state];\n"
+        "            length = pos;\n"
+        "        }\n"
+        "    }\n\n"
+        "    return type;\n"
+        "}\n"
+
+        "// moves the unconsumed bytes to the front of the buffer, growing it only if a single token fills it, and\n"
+        "// reads more input after them\n"
+        "bool Lexer::refill() {\n"
+        "    if (eof)\n"
+        "        return false;\n\n"
+        "    if (start) {\n"
+        "        std::memmove(buffer.data(), buffer.data() + start, fill - start);\n"
+        "        fill -= start;\n"
+        "        start = 0;\n"
+        "    }\n"
+        "    if (fill == buffer.size())\n"
+        "        buffer.resize(buffer.size() * 2);\n\n"
+        "    size_t count = read(buffer.data() + fill, buffer.size() - fill);\n"
+        "    if (!count) {\n"
+        "        eof = true;\n"
+        "        return false;\n"
+        "    }\n\n"
+        "    fill += count;\n"
+        "    return true;\n"
+        "}\n";
+}
+void CodeGen::printTables(std::ostream &out) const {
+    const size_t numClasses = table[0].size();
+
+    out << "\nnamespace {\n"
+        "    const " << tableType(numClasses - 1) << " charClass[256] = {";
+    for (size_t c = 0; c < charClass.size(); c++)
+        out << ((c % 16) ? " " : "\n        ") << charClass[c] << ',';
+    out << "\n    };\n\n";
+
+    // row 0 is the dead state so that the scan loop can index the table before testing for failure
+    out << "    const " << tableType(types.size()) << " accepting[" << table.size() + 1 << "] = {\n"
+        "        0,";
+    for (size_t state = 0; state < accepts.size(); state++)
+        out << ((state % 16 == 15) ? "\n        " : " ") << accepts[state] << ',';
+    out << "\n    };\n\n";
+
+    out << "    const " << tableType(table.size()) << " transitions[" << table.size() + 1 << "][" << numClasses << "] = {\n"
+        "        {";
+    for (size_t charIndex = 0; charIndex < numClasses; charIndex++)
+        out << (charIndex ? ", 0" : " 0");
+    out << " },\n";
+    for (const auto &row : table) {
+        out << "        {";
+        for (size_t charIndex = 0; charIndex < row.size(); charIndex++)
+            out << (charIndex ? ", " : " ") << (charIndex ? row[charIndex] : 0);
+        out << " },\n";
+    }
+    out << "    };\n"
+        "}\n";
+}
+void CodeGen::printDirectScan(std::ostream &out) const {
+    // the start state is entered by falling into it, so it needs a label only if some state also jumps back to it
+    bool startTargeted = std::any_of(states.begin(), states.end(), [&](const pState &state) {
+        return state->Targets(states[0].get());
+    });
+
+    out << "\nLexer::Type Lexer::Scan(Iterator &it, Iterator end) {\n"
+        "    Type type = INVALID;\n"
+        "    Iterator accept = it;\n\n";
+    states[0]->PrintDefinition(out, startTargeted);
+    for (size_t i = 1; i < states.size(); i++)
+        if (!states[i]->Empty())
+            states[i]->PrintDefinition(out, true);
+    out << "done:\n"
+        "    it = accept;\n"
+        "    return type;\n"
+        "}\n";
+}
+void CodeGen::printScan(std::ostream &out) const {
+    out << "\nLexer::Type Lexer::Scan(Iterator &it, Iterator end) {\n"
+        "    Type type = INVALID;\n"
+        "    Iterator accept = it;\n\n"
+        "    for (size_t state = 1; it != end;) {\n"
+        "        state = transitions[state][charClass[(unsigned char)*it++]];\n"
+        "        if (!state)\n"
+        "            break;\n\n"
+        "        if (accepting[state]) {\n"
+        "            type = (Type)accepting[state];\n"
+        "            accept = it;\n"
+        "        }\n"
+        "    }\n\n"
+        "    it = accept;\n"
+        "    return type;\n"
+        "}\n";
+}
+void CodeGen::printSkips(std::ostream &out) const {
+    // each kernel tests a whole block against every range, using the unsigned compare (c - lo) <= (hi - lo) that
+    // SSE2 lacks as a saturating subtraction that must reach zero
+    auto printBlock = [&](const Skip &skip, const char *mm, const char *si, size_t width) {
+        auto set = [&](const std::string &value) { return std::string(mm) + "_set1_epi8(" + value + ")"; };
+        auto test = [&](const std::pair<unsigned char, unsigned char> &range) {
+            std::string lo = set("'"s + CharLiteral((char)range.first) + "'");
+            if (range.first == range.second)
+                return std::string(mm) + "_cmpeq_epi8(x, " + lo + ")";
+            return std::string(mm) + "_cmpeq_epi8(" + mm + "_subs_epu8(" + mm + "_sub_epi8(x, " + lo + "), " +
+                set("(char)" + std::to_string(range.second - range.first)) + "), " + mm + "_setzero_" + si + "())";
+        };
+        std::string vec = "__m"s + std::to_string(width * 8) + "i";
+
+        out << "        for (; end - it >= " << width << "; it += " << width << ") {\n"
+            "            " << vec << " x = " << mm << "_loadu_" << si << "((const " << vec << " *)&*it);\n"
+            "            " << vec << " hit = " << test(skip.ranges[0]) << ";\n";
+        for (size_t i = 1; i < skip.ranges.size(); i++)
+            out << "            hit = " << mm << "_or_" << si << "(hit, " << test(skip.ranges[i]) << ");\n";
+        out << "            unsigned stop = ";
+        if (!skip.stop)
+            out << (width == 16 ? "0xffff & ~" : "~");
+        out << "(unsigned)" << mm << "_movemask_epi8(hit);\n"
+            "            if (stop)\n"
+            "                return it + firstSet(stop);\n"
+            "        }\n";
+    };
+
+    out << "\n#if !defined(LEXER_NO_SIMD) && defined(__AVX2__)\n"
+        "#define LEXER_AVX2\n"
+        "#endif\n"
+        "#if !defined(LEXER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))\n"
+        "#define LEXER_SSE2\n"
+        "#include <immintrin.h>\n"
+        "#endif\n\n"
+        "namespace {\n"
+        "#ifdef LEXER_SSE2\n"
+        "    inline unsigned firstSet(unsigned mask) {\n"
+        "#ifdef _MSC_VER\n"
+        "        unsigned long index;\n"
+        "        _BitScanForward(&index, mask);\n"
+        "        return index;\n"
+        "#else\n"
+        "        return __builtin_ctz(mask);\n"
+        "#endif\n"
+        "    }\n"
+        "#endif\n";
+
+    for (size_t i = 0; i < skips.size(); i++) {
+        const Skip &skip = skips[i];
+
+        out << "\n    // skips " << (skip.stop ? "[^" : "[");
+        for (const auto &range : skip.ranges) {
+            out << CharLiteral((char)range.first);
+            if (range.second != range.first)
+                out << '-' << CharLiteral((char)range.second);
+        }
+        out << "]*\n"
+            "    std::string::const_iterator Skip_" << i + 1 << "(std::string::const_iterator it, std::string::const_iterator end) {\n"
+            "#ifdef LEXER_AVX2\n";
+        printBlock(skip, "_mm256", "si256", 32);
+        out << "#endif\n"
+            "#ifdef LEXER_SSE2\n";
+        printBlock(skip, "_mm", "si128", 16);
+        out << "#endif\n"
+            "        while (it != end && " << (skip.stop ? "!(" : "(");
+        for (size_t r = 0; r < skip.ranges.size(); r++) {
+            const auto &range = skip.ranges[r];
+            out << (r ? " || " : "");
+            if (range.first == range.second)
+                out << "*it == '" << CharLiteral((char)range.first) << '\'';
+            else
+                out << "(unsigned char)(*it - '" << CharLiteral((char)range.first) << "') <= " << range.second - range.first;
+        }
+        out << "))\n"
+            "            ++it;\n"
+            "        return it;\n"
+            "    }\n";
+    }
+    out << "}\n";
+}
+const char *CodeGen::tableType(size_t maxValue) {
+    if (maxValue <= UINT8_MAX)
+        return "std::uint8_t";
+    if (maxValue <= UINT16_MAX)
+        return "std::uint16_t";
+    return "std::uint32_t";
+}
 void CodeGen::State::AddTransitions(std::vector<Transition> &&transList)
 {
     std::vector<bool> marked(transList.size(), false);
@@ -508,37 +1583,37 @@ void CodeGen::State::AddTransitions(std::vector<Transition> &&transList)
     {
         if (!marked[i])
         {
-            transitions.emplace_back(transList[i].to, std::vector<size_t>(1, transList[i].charIndex));
+            transitions.emplace_back(transList[i].to, std::vector<char>(1, transList[i].c));
             for (size_t j = i + 1; j < transList.size(); j++)
             {
                 if (transList[j].to == transList[i].to)
                 {
                     marked[j] = true;
-                    transitions.back().charIndices.push_back(transList[j].charIndex);
+                    transitions.back().chars.push_back(transList[j].c);
                 }
             }
         }
     }
 }
-std::string CodeGen::State::Call(bool useCont) const
+const std::vector<char> *CodeGen::State::SelfLoop() const
 {
-    if (transitions.size() != 0)
-    {
-        std::string result = "State_";
-        result += std::to_string(newState);
-        if (useCont)
-            result += "(cont, end)";
-        else
-            result += "(it, end)";
-        return result;
-    }
-    return ToUpper(types[accepting - 1]);
+    for (const TransGroup &transGroup : transitions)
+        if (transGroup.to == this)
+            return &transGroup.chars;
+    return nullptr;
+}
+bool CodeGen::State::Targets(const State *state) const
+{
+    for (const TransGroup &transGroup : transitions)
+        if (transGroup.to == state && !(skip && state == this))
+            return true;
+    return false;
 }
 void CodeGen::State::PrintTransitions(std::ostream &os) const
 {
     os << "State " << oldState << ':';
     if (accepting)
-        os << " Accepts " << types[accepting - 1];
+        os << " Accepts " << type;
     os << '\n';
     for (const TransGroup &transGroup : transitions)
     {
@@ -546,66 +1621,54 @@ void CodeGen::State::PrintTransitions(std::ostream &os) const
         size_t i = 0;
         while (true)
         {
-            char c = NFA::Alphabet(transGroup.charIndices[i]);
-            if (c == '\n')
-                os << "\\n";
-            else if (c == ' ')
+            char c = transGroup.chars[i];
+            if (c == ' ')
                 os << "\\s";
-            else if (c == '\t')
-                os << "\\t";
             else
-                os << c;
-            if (++i == transGroup.charIndices.size())
+                os << CharLiteral(c);
+            if (++i == transGroup.chars.size())
                 break;
             os << ", ";
         }
         os << " } -> " << transGroup.to->oldState << '\n';
     }
 }
-void CodeGen::State::PrintDefinition(std::ostream &out) const
+void CodeGen::State::PrintDefinition(std::ostream &out, bool label) const
 {
-    out << "Lexer::Type Lexer::State_" << newState << "(Iterator &it, Iterator end) {\n"
-        "    if (it != end) {\n";
-    if (accepting)
-        out << "        Iterator cont = it;\n"
-        "        Type contValid = INVALID;\n\n"
-        "        switch (*cont++) {\n";
-    else
-        out << "        switch (*it++) {\n";
+    if (label)
+        out << "state_" << newState << ":\n";
+    // the kernel consumes the whole run of the state's own loop, so the next byte can only leave the state
+    if (skip)
+        out << "    it = Skip_" << skip << "(it, end);\n";
+    // a token is at least one byte long, so the start state only accepts once a loop has led back into it; until
+    // then 'accept' is still where the scan began
+    if (accepting && newState == 1)
+        out << "    if (it != accept) {\n"
+        "        type = " << ToUpper(type) << ";\n"
+        "        accept = it;\n"
+        "    }\n";
+    else if (accepting)
+        out << "    type = " << ToUpper(type) << ";\n"
+        "    accept = it;\n";
+    out << "    if (it == end)\n"
+        "        goto done;\n\n"
+        "    switch (*it++) {\n";
     for (const TransGroup &transition : transitions)
     {
-        for (size_t charIndex : transition.charIndices) {
-            out << "        case '";
-
-            char c = NFA::Alphabet(charIndex);
-            if (c == '\n')
-                out << "\\n";
-            else if (c == '\t')
-                out << "\\t";
-            else
-                out << c;
-
-            out << "':\n";
-        }
-        if (accepting)
-            out << "            contValid = " << transition.to->Call(true) << ";\n"
-            "            break;\n";
+        if (skip && transition.to == this)
+            continue;
+        for (char c : transition.chars)
+            out << "    case '" << CharLiteral(c) << "':\n";
+        // a state without transitions can only accept, so there is nothing to jump to
+        if (transition.to->Empty())
+            out << "        type = " << ToUpper(transition.to->type) << ";\n"
+            "        accept = it;\n"
+            "        goto done;\n";
         else
-            out << "            return " << transition.to->Call(false) << ";\n";
+            out << "        goto state_" << transition.to->newState << ";\n";
     }
-    if (accepting)
-        out << "        }\n\n"
-        "        if (contValid != INVALID) {\n"
-        "            it = cont;\n"
-        "            return contValid;\n"
-        "        }\n"
-        "    }\n\n"
-        "    return " << ToUpper(types[accepting - 1]) << ";\n";
-    else
-        out << "        }\n"
-        "    }\n\n"
-        "    return INVALID;\n";
-    out << "}\n";
+    out << "    }\n"
+        "    goto done;\n\n";
 }
 
 std::string ToUpper(const std::string &src)
@@ -614,3 +1677,23 @@ std::string ToUpper(const std::string &src)
     std::transform(src.begin(), src.end(), result.begin(), (int(*)(int))std::toupper);
     return result;
 }
+std::string CharLiteral(char c)
+{
+    switch (c)
+    {
+    case '\n':
+        return "\\n";
+    case '\t':
+        return "\\t";
+    case '\'':
+        return "\\'";
+    case '\\':
+        return "\\\\";
+    }
+
+    if (std::isprint((unsigned char)c))
+        return std::string(1, c);
+
+    const char *digits = "0123456789abcdef";
+    return "\\x"s + digits[(unsigned char)c >> 4] + digits[c & 0xf];
+}
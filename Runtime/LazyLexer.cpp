@@ -0,0 +1,92 @@
+#include "LazyLexer.h"
+
+#include "SpecParser.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+
+LazyDFA::LazyDFA(const std::string &spec, size_t maxStates_) : maxStates(std::max<size_t>(maxStates_, 3)) {
+    std::istringstream in(spec);
+    Parser parser(in);
+    if (!parser.ParseInput())
+        throw SpecError(parser.GetError());
+
+    types = parser.GetTypes();
+    types.insert(types.begin(), "INVALID");
+    nfa = NFA::Merge(parser.GetNFAs());
+    charClass = nfa.CharClasses();
+    numClasses = nfa.AlphabetSize();
+
+    flush();
+    flushes = 0;
+}
+
+LazyDFA::Type LazyDFA::Scan(const char *&it, const char *end) {
+    Type type = INVALID;
+    const char *accept = it, *at = it;
+
+    // the start state's acceptance is never read, as a token is at least one byte long
+    for (std::uint32_t state = 0; at != end;) {
+        size_t cIndex = charClass[(unsigned char)*at];
+        std::uint32_t to = next[state * numClasses + cIndex];
+        if (to == UNKNOWN)
+            to = expand(state, cIndex);
+        if (to == DEAD)
+            break;
+
+        state = to;
+        at++;
+        if (accepting[state]) {
+            type = accepting[state];
+            accept = at;
+        }
+    }
+
+    it = accept;
+    return type;
+}
+const std::string &LazyDFA::Name(Type type) const {
+    return types[type];
+}
+
+std::uint32_t LazyDFA::expand(std::uint32_t state, size_t cIndex) {
+    Bitset subset = nfa.Move(*subsets[state], cIndex);
+    if (!subset.Any())
+        return next[state * numClasses + cIndex] = DEAD;
+
+    if (auto found = ids.find(subset); found != ids.end())
+        return next[state * numClasses + cIndex] = found->second;
+
+    // the state being left has to survive the flush, since the transition is recorded on it
+    if (subsets.size() + 1 > maxStates) {
+        Bitset current = *subsets[state];
+        flush();
+        state = intern(std::move(current));
+    }
+
+    std::uint32_t to = intern(std::move(subset));
+    return next[state * numClasses + cIndex] = to;
+}
+std::uint32_t LazyDFA::intern(Bitset &&subset) {
+    auto [entry, inserted] = ids.try_emplace(std::move(subset), (std::uint32_t)subsets.size());
+    if (inserted) {
+        subsets.push_back(&entry->first);
+        accepting.push_back(nfa.Accepting(entry->first));
+
+        // bytes that label no edge lead nowhere from any state
+        next.resize(next.size() + numClasses, UNKNOWN);
+        next[next.size() - numClasses + NFA::EPSILON] = DEAD;
+    }
+    return entry->second;
+}
+void LazyDFA::flush() {
+    ids.clear();
+    subsets.clear();
+    accepting.clear();
+    next.clear();
+    flushes++;
+
+    intern(nfa.Start());
+}
@@ -0,0 +1,73 @@
+#ifndef LAZY_LEXER_H__
+#define LAZY_LEXER_H__
+
+#include "Bitset.h"
+#include "NondeterministicFiniteAutomata.h"
+#include "RuntimeLexer.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class SpecError : public std::runtime_error {
+public:
+    explicit SpecError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+// The rules of a spec loaded at runtime, matched by a DFA that is built while it runs. Each DFA state is determinized
+// from the NFA the first time a scan reaches it and cached with its transitions from then on. When the cache holds
+// 'maxStates' states it is flushed whole, keeping only the start state and the state being left, so memory stays
+// bounded whatever the input.
+//
+// Scanning fills the cache, so a LazyDFA must not be shared between threads that scan at the same time.
+class LazyDFA {
+public:
+    using Type = size_t;
+    static constexpr Type INVALID = 0;
+
+    // throws SpecError if the spec is malformed
+    explicit LazyDFA(const std::string &spec, size_t maxStates_ = 10000);
+
+    LazyDFA(const LazyDFA &) = delete;
+    LazyDFA &operator=(const LazyDFA &) = delete;
+
+    // Matches the longest token of at least one byte at 'it' and moves 'it' past it. Returns INVALID, and leaves 'it'
+    // alone, when no rule matches; otherwise returns the earliest rule among those that match the longest token
+    Type Scan(const char *&it, const char *end);
+
+    // rules are numbered from 1 in the order of the spec; the name of INVALID is "INVALID"
+    size_t Rules() const noexcept { return types.size() - 1; }
+    const std::string &Name(Type type) const;
+
+    size_t CachedStates() const noexcept { return subsets.size(); }
+    size_t Flushes() const noexcept { return flushes; }
+
+private:
+    static constexpr std::uint32_t UNKNOWN = UINT32_MAX;
+    static constexpr std::uint32_t DEAD = UINT32_MAX - 1;
+
+    std::uint32_t expand(std::uint32_t state, size_t cIndex);
+    std::uint32_t intern(Bitset &&subset);
+    void flush();
+
+    NFA nfa;
+    std::vector<std::string> types;
+    std::vector<size_t> charClass;
+    size_t numClasses;
+    size_t maxStates;
+    size_t flushes = 0;
+
+    // subsets are interned by value; 'subsets' points at the keys, which stay put when the table rehashes. The
+    // transitions of each state are a row of 'next' indexed by class
+    std::unordered_map<Bitset, std::uint32_t> ids;
+    std::vector<const Bitset *> subsets;
+    std::vector<Type> accepting;
+    std::vector<std::uint32_t> next;
+};
+
+using LazyLexer = RuntimeLexer<LazyDFA>;
+
+#endif
@@ -0,0 +1,154 @@
+#include "MappedLexer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace dfaFormat;
+
+
+MappedDFA::MappedDFA(const std::string &path) {
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        throw DfaFileError("Failed to open file: " + path);
+    }
+    LARGE_INTEGER length;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+        size = (size_t)length.QuadPart;
+        if ((mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)))
+            base = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw DfaFileError("Failed to open file: " + path);
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = (size_t)info.st_size;
+        void *view = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (view != MAP_FAILED)
+            base = static_cast<const unsigned char *>(view);
+    }
+    close(fd);
+#endif
+    if (!base) {
+        unmap();
+        throw DfaFileError("Failed to map file: " + path);
+    }
+
+    // only the header and the section bounds are checked here, so opening takes the same time for any size of DFA
+    header = reinterpret_cast<const Header *>(base);
+    auto fits = [&](std::uint64_t offset, std::uint64_t length) { return offset % 8 == 0 && offset + length <= size; };
+    bool valid = size >= sizeof(Header) &&
+        std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+        header->version == VERSION &&
+        header->byteOrder == ORDER_MARK &&
+        header->size == size &&
+        header->states > 0 && header->classes > 0 &&
+        header->width == Width(std::max(header->states, header->types)) &&
+        fits(header->classOffset, 256 * sizeof(std::uint16_t)) &&
+        fits(header->transOffset, (std::uint64_t)header->states * header->classes * header->width) &&
+        fits(header->acceptOffset, (std::uint64_t)header->states * header->width) &&
+        fits(header->nameOffset, ((std::uint64_t)header->types + 2) * sizeof(std::uint32_t));
+    if (!valid) {
+        unmap();
+        throw DfaFileError("Not a binary DFA of version " + std::to_string(VERSION) + ": " + path);
+    }
+
+    charClass = reinterpret_cast<const std::uint16_t *>(base + header->classOffset);
+    transitions = base + header->transOffset;
+    accepting = base + header->acceptOffset;
+    nameStart = reinterpret_cast<const std::uint32_t *>(base + header->nameOffset);
+    names = reinterpret_cast<const char *>(nameStart + header->types + 2);
+}
+MappedDFA::~MappedDFA() {
+    unmap();
+}
+
+bool MappedDFA::Verify() const {
+    for (size_t c = 0; c < 256; c++)
+        if (charClass[c] >= header->classes)
+            return false;
+    for (size_t i = 0; i < (size_t)header->states * header->classes; i++)
+        if (wide(transitions, i) > header->states)
+            return false;
+    for (size_t i = 0; i < header->states; i++)
+        if (wide(accepting, i) > header->types)
+            return false;
+
+    size_t text = size - (size_t)(names - reinterpret_cast<const char *>(base));
+    if (nameStart[0] != 0 || nameStart[header->types + 1] > text)
+        return false;
+    for (size_t type = 0; type <= header->types; type++)
+        if (nameStart[type] >= nameStart[type + 1] || names[nameStart[type + 1] - 1] != '\0')
+            return false;
+
+    return true;
+}
+
+MappedDFA::Type MappedDFA::Scan(const char *&it, const char *end) const {
+    switch (header->width) {
+    case 1:
+        return scan<std::uint8_t>(it, end);
+    case 2:
+        return scan<std::uint16_t>(it, end);
+    default:
+        return scan<std::uint32_t>(it, end);
+    }
+}
+template <typename T> MappedDFA::Type MappedDFA::scan(const char *&it, const char *end) const {
+    const T *trans = static_cast<const T *>(transitions), *accept = static_cast<const T *>(accepting);
+    const size_t classes = header->classes;
+
+    Type type = INVALID;
+    const char *at = it, *last = it;
+    for (size_t state = 1; at != end;) {
+        state = trans[(state - 1) * classes + charClass[(unsigned char)*at]];
+        if (!state)
+            break;
+
+        at++;
+        if (accept[state - 1]) {
+            type = accept[state - 1];
+            last = at;
+        }
+    }
+
+    it = last;
+    return type;
+}
+
+size_t MappedDFA::wide(const void *section, size_t i) const {
+    switch (header->width) {
+    case 1:
+        return static_cast<const std::uint8_t *>(section)[i];
+    case 2:
+        return static_cast<const std::uint16_t *>(section)[i];
+    default:
+        return static_cast<const std::uint32_t *>(section)[i];
+    }
+}
+void MappedDFA::unmap() noexcept {
+#ifdef _WIN32
+    if (base)
+        UnmapViewOfFile(base);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+#else
+    if (base)
+        munmap(const_cast<unsigned char *>(base), size);
+#endif
+    base = nullptr;
+}
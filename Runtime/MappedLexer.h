@@ -0,0 +1,66 @@
+#ifndef MAPPED_LEXER_H__
+#define MAPPED_LEXER_H__
+
+#include "DfaFormat.h"
+#include "RuntimeLexer.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+
+class DfaFileError : public std::runtime_error {
+public:
+    explicit DfaFileError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+// A DFA written by LexerGen --binary, mapped read-only and used in place. Opening it only checks the header and that
+// every section lies inside the file; Verify additionally checks every transition and name, which takes time in
+// proportion to the size of the file. The mapping is never written, so one MappedDFA can scan on any number of
+// threads at once, and processes that map the same file share its pages.
+class MappedDFA {
+public:
+    using Type = size_t;
+    static constexpr Type INVALID = 0;
+
+    // throws DfaFileError if the file cannot be mapped or does not hold a DFA of this version
+    explicit MappedDFA(const std::string &path);
+    ~MappedDFA();
+
+    MappedDFA(const MappedDFA &) = delete;
+    MappedDFA &operator=(const MappedDFA &) = delete;
+
+    bool Verify() const;
+
+    // Matches the longest token of at least one byte at 'it' and moves 'it' past it. Returns INVALID, and leaves 'it'
+    // alone, when no rule matches; otherwise returns the earliest rule among those that match the longest token
+    Type Scan(const char *&it, const char *end) const;
+
+    // rules are numbered from 1 in the order of the spec; the name of INVALID is "INVALID"
+    size_t Rules() const noexcept { return header->types; }
+    const char *Name(Type type) const { return names + nameStart[type]; }
+    size_t States() const noexcept { return header->states; }
+
+private:
+    template <typename T> Type scan(const char *&it, const char *end) const;
+    size_t wide(const void *section, size_t i) const;
+    void unmap() noexcept;
+
+    const unsigned char *base = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+
+    const dfaFormat::Header *header;
+    const std::uint16_t *charClass;
+    const void *transitions;
+    const void *accepting;
+    const std::uint32_t *nameStart;
+    const char *names;
+};
+
+using MappedLexer = RuntimeLexer<MappedDFA>;
+
+#endif
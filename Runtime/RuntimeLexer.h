@@ -0,0 +1,67 @@
+#ifndef RUNTIME_LEXER_H__
+#define RUNTIME_LEXER_H__
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+// Splits an input into tokens the way a lexer generated with --tokens=view does, with a DFA loaded at runtime.
+// Matcher is LazyDFA or MappedDFA. The input and the matcher must outlive the lexer.
+template <typename Matcher> class RuntimeLexer {
+public:
+    using Type = typename Matcher::Type;
+    struct Token {
+        Type Kind;
+        size_t Offset;
+        size_t Length;
+    };
+    struct Error {
+        std::string Token;
+    };
+
+    RuntimeLexer(Matcher &matcher_, const std::string &in) : matcher(&matcher_), in(&in), next(0) {}
+    bool CreateTokens();
+    // returns false on an error; at the end of the input 'token' is INVALID
+    bool NextToken(Token &token);
+    std::vector<Token> GetTokens() { return std::move(tokens); };
+    std::string_view Text(const Token &token) const { return { in->data() + token.Offset, token.Length }; }
+    Error GetErrorReport() { return std::move(err); }
+
+private:
+    Matcher *matcher;
+    const std::string *in;
+    size_t next;
+    std::vector<Token> tokens;
+    Error err;
+};
+
+template <typename Matcher> bool RuntimeLexer<Matcher>::CreateTokens() {
+    for (Token token;;) {
+        if (!NextToken(token))
+            return false;
+        if (token.Kind == Matcher::INVALID)
+            return true;
+
+        tokens.push_back(std::move(token));
+    }
+}
+template <typename Matcher> bool RuntimeLexer<Matcher>::NextToken(Token &token) {
+    const char *begin = in->data() + next, *it = begin, *end = in->data() + in->size();
+    token = { Matcher::INVALID, next, 0 };
+    if (it == end)
+        return true;
+
+    Type type = matcher->Scan(it, end);
+    if (type == Matcher::INVALID) {
+        err = { std::string(begin, end) };
+        return false;
+    }
+    token = { type, next, size_t(it - begin) };
+
+    next += it - begin;
+    return true;
+}
+
+#endif
@@ -0,0 +1,18 @@
+# Lexes INPUT with the LexDump executables LHS and RHS and fails unless they print the same tokens and error.
+#
+#   cmake -DLHS=<LexDump> -DRHS=<LexDump> -DINPUT=<file> -P CompareLexers.cmake
+
+foreach(side LHS RHS)
+    execute_process(
+        COMMAND ${${side}} ${INPUT}
+        OUTPUT_VARIABLE ${side}_OUTPUT
+        RESULT_VARIABLE result
+    )
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${${side}} ${INPUT} failed: ${result}")
+    endif()
+endforeach()
+
+if (NOT LHS_OUTPUT STREQUAL RHS_OUTPUT)
+    message(FATAL_ERROR "${LHS} and ${RHS} lex ${INPUT} differently:\n${LHS_OUTPUT}\n---\n${RHS_OUTPUT}")
+endif()
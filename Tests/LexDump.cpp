@@ -0,0 +1,69 @@
+#if defined(LEXDUMP_LAZY)
+#include "LazyLexer.h"
+#elif defined(LEXDUMP_MAPPED)
+#include "MappedLexer.h"
+#else
+#include "Lexer.h"
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+// Lexes a file with the --tokens=view lexer it was built against and prints one token per line as <name>[<text>],
+// followed by "error: <rest of the input>" if lexing stopped at an invalid token. Build with LEXDUMP_PARALLEL to lex
+// with CreateTokensParallel. LEXDUMP_LAZY="<spec>" lexes with the runtime LazyLexer on that spec instead, keeping at
+// most LEXDUMP_MAX_STATES states if that is defined, and LEXDUMP_MAPPED="<file>" with the MappedLexer on a --binary DFA.
+//
+//   LexDump <input>
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: LexDump <input>" << std::endl;
+        return 1;
+    }
+
+    auto read = [](const char *path, std::string &text) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Failed to open file: " << path << std::endl;
+            return false;
+        }
+        text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    };
+    std::string text;
+    if (!read(argv[1], text))
+        return 1;
+
+#if defined(LEXDUMP_LAZY)
+    std::string spec;
+    if (!read(LEXDUMP_LAZY, spec))
+        return 1;
+#ifdef LEXDUMP_MAX_STATES
+    LazyDFA dfa(spec, LEXDUMP_MAX_STATES);
+#else
+    LazyDFA dfa(spec);
+#endif
+    LazyLexer lexer(dfa, text);
+    auto name = [&](LazyDFA::Type type) { return dfa.Name(type); };
+#elif defined(LEXDUMP_MAPPED)
+    MappedDFA dfa(LEXDUMP_MAPPED);
+    MappedLexer lexer(dfa, text);
+    auto name = [&](MappedDFA::Type type) { return dfa.Name(type); };
+#else
+    Lexer lexer(text);
+    auto name = [](Lexer::Type type) { return Lexer::Name(type); };
+#endif
+#ifdef LEXDUMP_PARALLEL
+    bool ok = lexer.CreateTokensParallel(4);
+#else
+    bool ok = lexer.CreateTokens();
+#endif
+
+    for (const auto &token : lexer.GetTokens())
+        std::cout << name(token.Kind) << '[' << lexer.Text(token) << "]\n";
+    if (!ok)
+        std::cout << "error: " << lexer.GetErrorReport().Token << '\n';
+}
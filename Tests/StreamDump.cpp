@@ -0,0 +1,56 @@
+#include "Lexer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+// Lexes a file with the --stream lexer it was built against and prints what LexDump prints for a --tokens=view lexer.
+// The reader hands the lexer at most STREAMDUMP_CHUNK bytes a call, into a buffer of that size to begin with, so
+// tokens straddle refills. Every Terminal's Process must be the stub that sets the error message to the rule's name.
+//
+//   StreamDump <input>
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: StreamDump <input>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open file: " << argv[1] << std::endl;
+        return 1;
+    }
+    std::string text(std::istreambuf_iterator<char>(in), {});
+
+    size_t read = 0;
+    Lexer lexer([&](char *buffer, size_t size) {
+        size_t count = std::min({ size, (size_t)STREAMDUMP_CHUNK, text.size() - read });
+        std::memcpy(buffer, text.data() + read, count);
+        read += count;
+        return count;
+    }, STREAMDUMP_CHUNK);
+
+    bool ok = lexer.CreateTokens([](pTerminal token) {
+        Stack stack;
+        SymStack symStack;
+        SyntaxError name;
+        token->Process(stack, symStack, name);
+
+        // a token prints as its colored upper case name and brackets around the text
+        std::ostringstream printed;
+        printed << *token;
+        std::string colored = printed.str();
+        const std::string open = "\033[0m", close = "\033[31m]\033[0m";
+        size_t begin = colored.find(open) + open.size();
+        std::cout << name.Message << '[' << colored.substr(begin, colored.size() - close.size() - begin) << "]\n";
+    });
+
+    // the error holds only what the lexer had buffered, so the input it never read follows it
+    if (!ok)
+        std::cout << "error: " << lexer.GetErrorReport().Token << text.substr(read) << '\n';
+}
@@ -0,0 +1,109 @@
+#ifndef BITSET_H__
+#define BITSET_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// Dense, dynamically sized set of state numbers. All whole-set operations work a word at a time over contiguous
+// storage, which leaves the compiler free to vectorize them.
+class Bitset {
+public:
+    using Word = std::uint64_t;
+    static constexpr size_t WORD_BITS = 64;
+
+    Bitset() = default;
+    explicit Bitset(size_t size_) : size(size_), words((size_ + WORD_BITS - 1) / WORD_BITS, 0) {}
+
+    size_t Size() const noexcept { return size; }
+    bool Test(size_t i) const noexcept { return (words[i / WORD_BITS] >> (i % WORD_BITS)) & 1; }
+    void Set(size_t i) noexcept { words[i / WORD_BITS] |= Word(1) << (i % WORD_BITS); }
+    void Clear() noexcept { std::fill(words.begin(), words.end(), 0); }
+
+    bool Any() const noexcept;
+    size_t Count() const noexcept;
+    size_t Hash() const noexcept;
+    template <typename F> void ForEach(F &&f) const;
+
+    Bitset &operator|=(const Bitset &rhs) noexcept;
+    bool operator==(const Bitset &rhs) const noexcept { return size == rhs.size && words == rhs.words; }
+    bool operator!=(const Bitset &rhs) const noexcept { return !(*this == rhs); }
+
+private:
+    static size_t popCount(Word word) noexcept;
+    static size_t lowestBit(Word word) noexcept;
+
+    size_t size = 0;
+    std::vector<Word> words;
+};
+
+namespace std {
+    template <> struct hash<Bitset> {
+        size_t operator()(const Bitset &set) const noexcept { return set.Hash(); }
+    };
+}
+
+inline bool Bitset::Any() const noexcept {
+    Word any = 0;
+    for (Word word : words)
+        any |= word;
+    return any != 0;
+}
+inline size_t Bitset::Count() const noexcept {
+    size_t count = 0;
+    for (Word word : words)
+        count += popCount(word);
+    return count;
+}
+inline size_t Bitset::Hash() const noexcept {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (Word word : words)
+        hash = (hash ^ word) * 1099511628211ull;
+    return (size_t)(hash ^ (hash >> 32));
+}
+template <typename F> void Bitset::ForEach(F &&f) const {
+    for (size_t i = 0; i < words.size(); i++)
+        for (Word word = words[i]; word; word &= word - 1)
+            f(i * WORD_BITS + lowestBit(word));
+}
+
+inline Bitset &Bitset::operator|=(const Bitset &rhs) noexcept {
+    for (size_t i = 0; i < words.size(); i++)
+        words[i] |= rhs.words[i];
+    return *this;
+}
+
+inline size_t Bitset::popCount(Word word) noexcept {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return __popcnt64(word);
+#else
+    size_t count = 0;
+    for (; word; word &= word - 1)
+        count++;
+    return count;
+#endif
+}
+inline size_t Bitset::lowestBit(Word word) noexcept {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    size_t index = 0;
+    for (; !(word & 1); word >>= 1)
+        index++;
+    return index;
+#endif
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef DFA_FORMAT_H__
+#define DFA_FORMAT_H__
+
+#include <cstdint>
+
+
+// Layout of the binary DFA written by LexerGen --binary and mapped by MappedDFA. Every field is stored in the byte
+// order of the machine that wrote it, which 'byteOrder' records, and every section starts 8 byte aligned so it can be
+// used in place straight from the mapping:
+//
+//   Header
+//   uint16_t charClass[256]                  class of every byte; class 0 leads nowhere from any state
+//   T        transitions[states * classes]   row of each state, 1 based, with 0 for no transition
+//   T        accepting[states]               type each state accepts, 0 for none
+//   uint32_t nameStart[types + 2]            offsets of the names in the text that follows, with its length last
+//   char     names[]                         the type names, INVALID first, each ending in NUL
+//
+// T is the narrowest of uint8_t, uint16_t and uint32_t that holds both the number of states and the number of types.
+// State 1 is the start state.
+namespace dfaFormat {
+    constexpr char MAGIC[8] = { 'L', 'e', 'x', 'e', 'r', 'D', 'F', 'A' };
+    constexpr std::uint32_t VERSION = 1;
+    constexpr std::uint32_t ORDER_MARK = 0x01020304;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint32_t states;
+        std::uint32_t classes;
+        std::uint32_t types;
+        std::uint32_t width;  // sizeof(T)
+        std::uint32_t classOffset;
+        std::uint32_t transOffset;
+        std::uint32_t acceptOffset;
+        std::uint32_t nameOffset;
+        std::uint32_t size;
+        std::uint32_t reserved;
+    };
+
+    constexpr std::uint64_t Align(std::uint64_t offset) { return (offset + 7) & ~std::uint64_t(7); }
+    constexpr std::uint32_t Width(std::uint32_t maxValue) { return maxValue <= 0xFF ? 1 : maxValue <= 0xFFFF ? 2 : 4; }
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "Stats.h"
+
+#include <iomanip>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+
+void Stats::EndPhase(const char *name) {
+    Clock::time_point now = Clock::now();
+    phases.push_back({ name, std::chrono::duration<double, std::milli>(now - mark).count(), PeakMemory() });
+    mark = Clock::now();
+}
+void Stats::Print(std::ostream &out, Format format) const {
+    if (format == Format::Text)
+        printText(out);
+    else if (format == Format::Json)
+        printJson(out);
+}
+
+size_t Stats::PeakMemory() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#elif defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;  // bytes on macOS, kilobytes everywhere else
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+void Stats::printText(std::ostream &out) const {
+    double total = 0;
+    std::ios::fmtflags flags = out.flags();
+
+    out << std::left << std::setw(12) << "phase" << std::right << std::setw(12) << "time (ms)" << std::setw(18) << "peak memory (KiB)" << '\n';
+    for (const Phase &phase : phases) {
+        out << std::left << std::setw(12) << phase.name << std::right << std::fixed << std::setprecision(3) <<
+            std::setw(12) << phase.milliseconds << std::setw(18) << phase.peakMemory / 1024 << '\n';
+        total += phase.milliseconds;
+    }
+    out << std::left << std::setw(12) << "total" << std::right << std::setw(12) << total << "\n\n";
+
+    for (const auto &[name, value] : sizes)
+        out << name << ": " << value << '\n';
+
+    out.flags(flags);
+}
+void Stats::printJson(std::ostream &out) const {
+    // names are generator phases, sizes and file paths, so quotes and backslashes are all that need escaping
+    auto quote = [](const std::string &str) {
+        std::string result = "\"";
+        for (char c : str) {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            result += c;
+        }
+        return result + '"';
+    };
+    std::ios::fmtflags flags = out.flags();
+
+    out << "{\n  \"phases\": [";
+    for (size_t i = 0; i < phases.size(); i++)
+        out << (i ? ",\n" : "\n") << std::fixed << std::setprecision(3) <<
+            "    { \"name\": " << quote(phases[i].name) << ", \"ms\": " << phases[i].milliseconds <<
+            ", \"peak_bytes\": " << phases[i].peakMemory << " }";
+    out << "\n  ],\n  \"sizes\": {";
+    for (size_t i = 0; i < sizes.size(); i++)
+        out << (i ? ",\n" : "\n") << "    " << quote(sizes[i].first) << ": " << sizes[i].second;
+    out << "\n  }\n}\n";
+
+    out.flags(flags);
+}
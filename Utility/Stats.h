@@ -0,0 +1,42 @@
+#ifndef STATS_H__
+#define STATS_H__
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Wall time and peak memory of each generator phase, plus named sizes, for --stats. Phases run back to back: each
+// one ends where the next begins.
+class Stats {
+public:
+    enum class Format { None, Text, Json };
+
+    Stats() : mark(Clock::now()) {}
+
+    void EndPhase(const char *name);
+    void Record(const std::string &name, size_t value) { sizes.emplace_back(name, value); }
+    void Print(std::ostream &out, Format format) const;
+
+    // the process' high water mark of resident memory in bytes, or 0 where the platform cannot tell
+    static size_t PeakMemory();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Phase {
+        const char *name;
+        double milliseconds;
+        size_t peakMemory;
+    };
+
+    void printText(std::ostream &out) const;
+    void printJson(std::ostream &out) const;
+
+    Clock::time_point mark;
+    std::vector<Phase> phases;
+    std::vector<std::pair<std::string, size_t>> sizes;
+};
+
+#endif
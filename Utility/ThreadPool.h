@@ -0,0 +1,104 @@
+#ifndef THREAD_POOL_H__
+#define THREAD_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads for data-parallel loops. ForEach hands out indices one at a time from a shared counter,
+// so a thread that finishes its items early keeps taking work that would otherwise wait behind a slow one. The calling
+// thread works alongside the pool and gets back control only when every index has been processed.
+class ThreadPool {
+public:
+    // 0 threads means one per hardware thread; the calling thread counts as one of them
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t Size() const noexcept { return workers.size() + 1; }
+    template <typename F> void ForEach(size_t count, F &&f);
+
+private:
+    void work();
+    void drain();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::function<void(size_t)> task;
+    std::atomic<size_t> next{ 0 };
+    size_t count = 0;
+    size_t busy = 0;
+    size_t generation = 0;
+    bool stop = false;
+};
+
+inline ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+template <typename F> void ThreadPool::ForEach(size_t count_, F &&f) {
+    if (workers.empty() || count_ < 2) {
+        for (size_t i = 0; i < count_; i++)
+            f(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = std::ref(f);
+        count = count_;
+        next = 0;
+        busy = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    drain();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return busy == 0; });
+    task = nullptr;
+}
+
+inline void ThreadPool::work() {
+    for (size_t seen = 0;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop)
+                return;
+            seen = generation;
+        }
+
+        drain();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+            done.notify_one();
+    }
+}
+inline void ThreadPool::drain() {
+    for (size_t i; (i = next.fetch_add(1)) < count;)
+        task(i);
+}
+
+#endif